@@ -1,20 +1,18 @@
 #include "types.h"
 #include "user.h"
+#include "sched.h"
 
 int fibo(int n) {
 	if(n <= 1) return 1;
 	return fibo(n-1) + fibo(n-2);
 }
 
-int
-main(int argc, char *argv[])
-{
-	if (argc != 2){
-		printf(1, "Usage: SMLsanity <n>\n");
-		exit();
- 	}
-
-	int n = atoi(argv[1]), j = 0, retime, rutime, stime, ctime;
+// Runs 3n CPU-bound children, a third at each priority, and
+// reports their ready, running and sleeping times.  Priorities are
+// only set under the classes that use them as given.
+void bench(int n) {
+	int j = 0, first = 0, retime, rutime, stime, ctime;
+	int policy = setsched(-1);
 
 	int avgRetime[3], avgRutime[3], avgStime[3];
 	memset(avgRetime, 0, sizeof(avgRetime));
@@ -26,8 +24,7 @@ main(int argc, char *argv[])
 		int pid = fork();
 		if (pid == 0) {
 			//child
-			j = (getpid() - 4) % 3; // ensures independence from the first son's pid when gathering the results in the second part of the program
-			#ifdef SML
+			if (policy == SCHED_SML || policy == SCHED_CFS) {
 				switch(j) {
 					case 0:
 						set_prio(1);
@@ -39,7 +36,7 @@ main(int argc, char *argv[])
 						set_prio(3);
 						break;
 				}
-			#endif
+			}
 			for (int k = 0; k < 100; k++){
 				for (j = 0; j < 1000000; j++){
 					fibo(2);
@@ -47,11 +44,13 @@ main(int argc, char *argv[])
 			}
 			exit(); // children exit here
 		}
+		if (i == 0)
+			first = pid;
 		continue; // father continues to spawn the next child
 	}
 	for (int i = 0; i < 3 * n; i++) {
 		int pid = wait2(&retime, &rutime, &stime, &ctime);
-		int res = (pid - 4) % 3; // correlates to j in the dispatching loop
+		int res = (pid - first) % 3; // correlates to j in the dispatching loop
 		switch(res) {
 			case 0:
 				printf(1, "Priority 1, pid: %d, ready: %d, running: %d, sleeping: %d, turnaround: %d, creation time: %d, end time: %d\n", pid, retime, rutime, stime, retime + rutime + stime, ctime, ctime + retime + rutime + stime);
@@ -82,5 +81,33 @@ main(int argc, char *argv[])
   	printf(1, "\n\nPriority 1:\nAverage ready time: %d\nAverage running time: %d\nAverage sleeping time: %d\nAverage turnaround time: %d\n\n\n", avgRetime[0], avgRutime[0], avgStime[0], avgRetime[0] + avgRutime[0] + avgStime[0]);
 	printf(1, "Priority 2:\nAverage ready time: %d\nAverage running time: %d\nAverage sleeping time: %d\nAverage turnaround time: %d\n\n\n", avgRetime[1], avgRutime[1], avgStime[1], avgRetime[1] + avgRutime[1] + avgStime[1]);
 	printf(1, "Priority 3:\nAverage ready time: %d\nAverage running time: %d\nAverage sleeping time: %d\nAverage turnaround time: %d\n\n\n", avgRetime[2], avgRutime[2], avgStime[2], avgRetime[2] + avgRutime[2] + avgStime[2]);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static char *policies[] = SCHEDNAMES;
+	int old;
+
+	if (argc != 2 && (argc != 3 || strcmp(argv[2], "all") != 0)){
+		printf(1, "Usage: SMLsanity <n> [all]\n");
+		exit();
+ 	}
+
+	int n = atoi(argv[1]);
+	if (argc == 2) {
+		bench(n);
+		exit();
+	}
+
+	// Run the sweep under every scheduling class in turn.
+	old = setsched(-1);
+	for (int c = 0; c < NSCHED; c++) {
+		setsched(c);
+		printf(1, "Scheduling policy: %s\n\n", policies[c]);
+		bench(n);
+		printf(1, "\n");
+	}
+	setsched(old);
 	exit();
 }
\ No newline at end of file
@@ -1,13 +1,14 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
-// * After changing buffer data, call bwrite to write it to disk.
+// * After changing buffer data, call bwrite to write it to disk,
+//     or bwritev to write several at once.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
@@ -17,41 +18,152 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// A buffer lives in the bucket that (dev, blockno) hashes to, on
+// a list kept in LRU order, and each bucket has its own lock, so
+// lookups of different blocks do not contend.  A miss takes the
+// least recently used free buffer from whichever bucket holds it
+// and moves it over, locking one bucket at a time.  binit() sizes
+// the cache to the memory free at boot.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
 
-struct {
-  struct spinlock lock;
-  struct buf buf[NBUF];
+#define NBUCKET 31
 
-  // Linked list of all buffers, through prev/next.
+struct bucket {
+  struct spinlock lock;
+  // Linked list of the bucket's buffers, through prev/next.
   // head.next is most recently used.
   struct buf head;
+};
+
+struct {
+  struct bucket bucket[NBUCKET];
+  int nbuf;
 } bcache;
 
+static struct bucket*
+bhash(uint dev, uint blockno)
+{
+  return &bcache.bucket[(dev * 1031 + blockno) % NBUCKET];
+}
+
+// Put b at the front (most recently used end) of bucket bk.
+static void
+bpush(struct bucket *bk, struct buf *b)
+{
+  b->next = bk->head.next;
+  b->prev = &bk->head;
+  bk->head.next->prev = b;
+  bk->head.next = b;
+}
+
+static void
+bunlink(struct buf *b)
+{
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+}
+
 void
 binit(void)
 {
+  struct bucket *bk;
   struct buf *b;
+  char *hdr, *data;
+  int i, nhdr, ndata;
 
-  initlock(&bcache.lock, "bcache");
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    initlock(&bk->lock, "bcache");
+    bk->head.prev = &bk->head;
+    bk->head.next = &bk->head;
+  }
 
 //PAGEBREAK!
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+  // Give the cache 1/BCACHEFRAC of the memory free at boot, but
+  // at least NBUF buffers.  Headers and data come from separate
+  // pages, so a buffer never straddles two pages.
+  bcache.nbuf = kfreepages() * PGSIZE / BCACHEFRAC / (sizeof(struct buf) + BSIZE);
+  if(bcache.nbuf < NBUF)
+    bcache.nbuf = NBUF;
+  hdr = data = 0;
+  nhdr = ndata = 0;
+  for(i = 0; i < bcache.nbuf; i++){
+    if(nhdr == 0){
+      if((hdr = kalloc()) == 0)
+        panic("binit");
+      nhdr = PGSIZE / sizeof(struct buf);
+    }
+    if(ndata == 0){
+      if((data = kalloc()) == 0)
+        panic("binit");
+      ndata = PGSIZE / BSIZE;
+    }
+    b = (struct buf*)hdr;
+    memset(b, 0, sizeof(*b));
+    b->data = (uchar*)data;
+    hdr += sizeof(struct buf);
+    data += BSIZE;
+    nhdr--;
+    ndata--;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    bpush(&bcache.bucket[i % NBUCKET], b);
+  }
+  cprintf("binit: %d buffers\n", bcache.nbuf);
+}
+
+// Take the least recently used buffer that is free (refcnt 0, and
+// not B_DIRTY, which means log.c has modified it but not yet
+// committed it) out of its bucket.  Buckets are scanned one lock
+// at a time, so the choice is rechecked before the buffer is
+// taken.
+static struct buf*
+bvictim(void)
+{
+  struct bucket *bk, *best;
+  struct buf *b, *victim;
+  uint oldest;
+
+  for(;;){
+    best = 0;
+    victim = 0;
+    oldest = 0;
+    for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+      acquire(&bk->lock);
+      for(b = bk->head.prev; b != &bk->head; b = b->prev){
+        if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0){
+          if(victim == 0 || (int)(b->lastuse - oldest) < 0){
+            best = bk;
+            victim = b;
+            oldest = b->lastuse;
+          }
+          break;
+        }
+      }
+      release(&bk->lock);
+    }
+    if(victim == 0)
+      panic("bget: no buffers");
+
+    // Take it if it is still its bucket's least recently used
+    // free buffer; otherwise look again.
+    acquire(&best->lock);
+    for(b = best->head.prev; b != &best->head; b = b->prev)
+      if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0)
+        break;
+    if(b == victim){
+      bunlink(victim);
+      release(&best->lock);
+      return victim;
+    }
+    release(&best->lock);
   }
 }
 
@@ -61,35 +173,49 @@ binit(void)
 static struct buf*
 bget(uint dev, uint blockno)
 {
-  struct buf *b;
+  struct bucket *bk = bhash(dev, blockno);
+  struct buf *b, *victim;
 
-  acquire(&bcache.lock);
+  acquire(&bk->lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = bk->head.next; b != &bk->head; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
-      release(&bcache.lock);
+      release(&bk->lock);
       acquiresleep(&b->lock);
       return b;
     }
   }
+  release(&bk->lock);
 
   // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
+  victim = bvictim();
+
+  acquire(&bk->lock);
+  // Another process may have cached the block in the meantime.
+  for(b = bk->head.next; b != &bk->head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      b->refcnt++;
+      // Keep the victim here, free, with no block in it.
+      victim->dev = victim->blockno = -1;
+      victim->flags = 0;
+      victim->lastuse = 0;
+      bpush(bk, victim);
+      release(&bk->lock);
       acquiresleep(&b->lock);
       return b;
     }
   }
-  panic("bget: no buffers");
+  b = victim;
+  b->dev = dev;
+  b->blockno = blockno;
+  b->flags = 0;
+  b->refcnt = 1;
+  bpush(bk, b);
+  release(&bk->lock);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -115,29 +241,44 @@ bwrite(struct buf *b)
   iderw(b);
 }
 
+// Write n locked bufs to disk with one request to the driver, so
+// that runs of consecutive blocks go out as single commands.
+void
+bwritev(struct buf **bv, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&bv[i]->lock))
+      panic("bwritev");
+    bv[i]->flags |= B_DIRTY;
+  }
+  iderwv(bv, n);
+}
+
 // Release a locked buffer.
-// Move to the head of the MRU list.
+// Move to the head of its bucket's MRU list.
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  bk = bhash(b->dev, b->blockno);
+  acquire(&bk->lock);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    bunlink(b);
+    bpush(bk, b);
+    b->lastuse = ticks;
   }
   
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 //PAGEBREAK!
 // Blank page.
@@ -4,10 +4,12 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
+  uint lastuse;      // ticks when last released, for LRU
   struct buf *prev; // LRU cache list
   struct buf *next;
   struct buf *qnext; // disk queue
-  uchar data[BSIZE];
+  uchar *page;       // if set, transfer a whole page here instead of data
+  uchar *data;       // BSIZE bytes, allocated by binit
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
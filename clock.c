@@ -0,0 +1,102 @@
+// High-resolution clock.
+//
+// Each CPU calibrates its time stamp counter against the 8253 PIT
+// at boot and keeps a scale factor turning TSC cycles into
+// nanoseconds.  The clock counts from the boot CPU's calibration;
+// it assumes the CPUs' counters run in step, as they do on QEMU
+// and on processors with an invariant TSC.
+//
+// The kernel has no libgcc, so there is no general 64-bit
+// division: cycles are scaled by multiplying by tscmult and
+// shifting right by TSCSHIFT, and the few divisions left divide
+// 64 bits by 32 with divl.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "clock.h"
+
+#define PIT_HZ     1193182   // PIT input clock
+#define PIT_CH2    0x42      // Channel 2 counter
+#define PIT_MODE   0x43
+#define PIT_PORTB  0x61      // Channel 2 gate (bit 0) and output (bit 5)
+#define CALCOUNT   11932     // PIT counts to calibrate over, ~10 ms
+
+#define TSCSHIFT   24
+
+static uint64 tscbase;      // Boot CPU's TSC at calibration
+
+// n / d, for a quotient known to fit in 32 bits.
+static uint
+div64(uint64 n, uint d, uint *rem)
+{
+  uint q, r;
+
+  asm("divl %4" : "=a" (q), "=d" (r) : "0" ((uint)n), "1" ((uint)(n >> 32)), "rm" (d));
+  if(rem)
+    *rem = r;
+  return q;
+}
+
+// Calibrate this CPU's TSC: count its cycles while the PIT counts
+// down CALCOUNT.  Called by each CPU as it starts, one at a time.
+void
+clockinit(void)
+{
+  struct cpu *c = mycpu();
+  uint64 t0, t1;
+  uint ns, i;
+
+  outb(PIT_PORTB, (inb(PIT_PORTB) & ~0x02) | 0x01);  // Gate on, speaker off
+  outb(PIT_MODE, 0xB0);        // Channel 2, lo/hi byte, mode 0
+  outb(PIT_CH2, CALCOUNT & 0xFF);
+  outb(PIT_CH2, CALCOUNT >> 8);
+  t0 = rdtsc();
+  for(i = 0; i < 10000000 && (inb(PIT_PORTB) & 0x20) == 0; i++)
+    ;
+  t1 = rdtsc();
+
+  ns = div64((uint64)CALCOUNT * 1000000000, PIT_HZ, 0);
+  if((inb(PIT_PORTB) & 0x20) == 0 || t1 - t0 < (ns >> 7)){
+    cprintf("cpu%d: no PIT to calibrate the TSC; assuming 1 GHz\n", cpuid());
+    t1 = t0 + ns;
+  }
+  c->tscmult = div64((uint64)ns << TSCSHIFT, (uint)(t1 - t0), 0);
+  if(c == &cpus[0])
+    tscbase = t0;
+}
+
+// Nanoseconds since boot, by this CPU's TSC.
+uint64
+nsclock(void)
+{
+  uint64 t;
+  uint mult;
+
+  pushcli();
+  t = rdtsc() - tscbase;
+  mult = mycpu()->tscmult;
+  popcli();
+  return (((uint64)(uint)(t >> 32) * mult) << (32 - TSCSHIFT)) +
+         (((uint64)(uint)t * mult) >> TSCSHIFT);
+}
+
+// Split ns nanoseconds into *ts.
+void
+nstotimespec(uint64 ns, struct timespec *ts)
+{
+  ts->tv_sec = div64(ns, 1000000000, &ts->tv_nsec);
+}
+
+int
+clockgettime(int clock, struct timespec *ts)
+{
+  if(clock != CLOCK_MONOTONIC)
+    return -1;
+  nstotimespec(nsclock(), ts);
+  return 0;
+}
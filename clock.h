@@ -0,0 +1,14 @@
+// Clocks for clock_gettime().
+#define CLOCK_MONOTONIC 1   // Time since boot
+
+struct timespec {
+  uint tv_sec;
+  uint tv_nsec;
+};
+
+// An exited child's time in each state, from wait3().
+struct proctimes {
+  struct timespec retime;   // RUNNABLE
+  struct timespec rutime;   // RUNNING
+  struct timespec stime;    // SLEEPING
+};
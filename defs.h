@@ -1,4 +1,5 @@
 struct buf;
+struct proctimes;
 struct context;
 struct file;
 struct inode;
@@ -9,12 +10,21 @@ struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct swapstat;
+struct timespec;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwritev(struct buf**, int);
+
+// clock.c
+void            clockinit(void);
+uint64          nsclock(void);
+void            nstotimespec(uint64, struct timespec*);
+int             clockgettime(int, struct timespec*);
 
 // console.c
 void            consoleinit(void);
@@ -25,6 +35,7 @@ int             getCmdFromHistory(char *, int );
 
 // exec.c
 int             exec(char*, char**);
+int             execload(struct proc*, uint, char*);
 
 // file.c
 struct file*    filealloc(void);
@@ -58,6 +69,7 @@ int             writei(struct inode*, char*, uint, uint);
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            iderwv(struct buf**, int);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -69,6 +81,16 @@ char*           kalloc(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+int             kfreepages(void);
+void            kflush(void);
+void            kref(char*);
+int             krefcount(char*);
+void            frameset(char*, pde_t*, uint);
+int             frameget(uint, pde_t**, uint*);
+void            framesetowner(pde_t*, struct proc*);
+struct proc*    frameowner(pde_t*);
+void            framesetslot(char*, uint);
+int             frametakeslot(char*);
 
 // kbd.c
 void            kbdintr(void);
@@ -80,6 +102,10 @@ extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
+void            lapictickless(uint);
+uint            lapictickresume(void);
+void            lapictimer(void);
+void            lapicipi(int, int);
 void            microdelay(int);
 
 // log.c
@@ -92,6 +118,11 @@ void            end_op();
 extern int      ismp;
 void            mpinit(void);
 
+// pci.c
+uint            pciread(uint, int);
+void            pciwrite(uint, int, uint);
+int             pcifind(int, uint, uint, uint*);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
@@ -120,15 +151,36 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
+int             wakeupproc(struct proc*, void*);
 void            yield(void);
-int             waitstats(int*, int*, int *, int *);
+int             waitstats(int*, int*, int *, int *, struct proctimes*);
 int             set_prio(int);
 void            create_kernel_process(const char *name, void (*entrypoint)());
 void            submitReqToSwapIn(void);
 void            submitReqToSwapOut(void);
+void            wakeSwapOut(void);
 void            swapoutprocess();
 void            swapinprocess();
-void            deleteSwapoutPageFiles();
+void            printSwapStats();
+int             getswapstats(int, struct swapstat*);
+int             setswaptrace(int);
+extern int      swaptrace;
+int             setsched(int);
+int             schedtick(void);
+void            clocksync(void);
+int             yieldto(int);
+int             setgroup(int);
+void            boost_prio(void);
+
+// swap.c
+void            swapinit(int);
+int             swapalloc(void);
+void            swapfree(uint);
+void            swapdup(uint);
+int             swapref(uint);
+void            swapread(uint, char*);
+void            swapreadv(uint*, char**, int);
+void            swapwrite(uint, char*);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -166,19 +218,28 @@ int             fetchstr(uint, char**);
 void            syscall(void);
 
 // timer.c
-void            timerinit(void);
+void            twsleep(uint);
+void            twrun(uint);
 
 // trap.c
 void            idtinit(void);
 extern uint     ticks;
 void            tvinit(void);
 extern struct spinlock tickslock;
+void            tickadvance(uint);
 
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
 
+// virtio.c
+extern int      virtioirq;
+void            virtioinit(void);
+int             virtiodisk(void);
+void            virtiorw(struct buf**, int);
+void            virtiointr(void);
+
 // vm.c
 void            seginit(void);
 void            kvmalloc(void);
@@ -190,6 +251,9 @@ void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
+int             cowfault(pde_t*, uint);
+int             lazyfault(struct proc*, uint);
+void            uvmprefault(struct proc*, uint, uint, int);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
@@ -6,16 +6,23 @@
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
+#include "sched.h"
 
+// Program text and data are not read in by exec(): the first
+// NEXECSEG loadable segments are recorded in the process and each
+// page is read from the executable when it is first touched (see
+// lazyfault() and execload()).  Any further segments are loaded
+// up front.
 int
 exec(char *path, char **argv)
 {
   char *s, *last;
-  int i, off;
+  int i, off, nseg;
   uint argc, sz, sp, ustack[3+MAXARG+1];
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *exe, *oldexe;
   struct proghdr ph;
+  struct execseg seg[NEXECSEG];
   pde_t *pgdir, *oldpgdir;
   struct proc *curproc = myproc();
 
@@ -28,6 +35,9 @@ exec(char *path, char **argv)
   }
   ilock(ip);
   pgdir = 0;
+  exe = 0;
+  nseg = 0;
+  memset(seg, 0, sizeof(seg));
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -49,13 +59,25 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
-      goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
+    if(nseg < NEXECSEG){
+      if(ph.vaddr + ph.memsz >= KERNBASE)
+        goto bad;
+      if(ph.vaddr + ph.memsz > sz)
+        sz = ph.vaddr + ph.memsz;
+      seg[nseg].va = ph.vaddr;
+      seg[nseg].off = ph.off;
+      seg[nseg].filesz = ph.filesz;
+      nseg++;
+      continue;
+    }
+    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+      goto bad;
     if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
+  exe = idup(ip);
   iunlockput(ip);
   end_op();
   ip = 0;
@@ -95,15 +117,24 @@ exec(char *path, char **argv)
   
   // Commit to the user image.
   oldpgdir = curproc->pgdir;
+  oldexe = curproc->exe;
   curproc->pgdir = pgdir;
+  framesetowner(pgdir, curproc);
   curproc->sz = sz;
+  curproc->exe = exe;
+  memmove(curproc->seg, seg, sizeof(seg));
+  curproc->ramask = 0;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
-  #ifdef DML
-  myproc()->priority = 2;
-  #endif
+  if(setsched(-1) == SCHED_DML)
+    myproc()->priority = 2;
   switchuvm(curproc);
   freevm(oldpgdir);
+  if(oldexe){
+    begin_op();
+    iput(oldexe);
+    end_op();
+  }
   return 0;
 
  bad:
@@ -113,5 +144,36 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(exe){
+    begin_op();
+    iput(exe);
+    end_op();
+  }
   return -1;
 }
+
+// Read the part of the page at va that comes from p's executable,
+// if va lies in a segment exec() left to be loaded on demand.
+// mem is the zeroed page.  Returns -1 if the read fails.
+int
+execload(struct proc *p, uint va, char *mem)
+{
+  struct execseg *s;
+  uint n;
+  int r;
+
+  if(p->exe == 0)
+    return 0;
+  for(s = p->seg; s < &p->seg[NEXECSEG]; s++){
+    if(s->filesz == 0 || va < s->va || va >= s->va + s->filesz)
+      continue;
+    n = s->va + s->filesz - va;
+    if(n > PGSIZE)
+      n = PGSIZE;
+    ilock(p->exe);
+    r = readi(p->exe, mem, s->off + (va - s->va), n);
+    iunlock(p->exe);
+    return r == n ? 0 : -1;
+  }
+  return 0;
+}
@@ -36,6 +36,8 @@ readsb(int dev, struct superblock *sb)
   bp = bread(dev, 1);
   memmove(sb, bp->data, sizeof(*sb));
   brelse(bp);
+  if(sb->bsize != BSIZE)
+    panic("readsb: block size");
 }
 
 // Zero a block.
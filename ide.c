@@ -1,4 +1,10 @@
-// Simple PIO-based (non-DMA) IDE driver code.
+// IDE driver code.
+//
+// Requests are queued in disk order and runs of consecutive blocks
+// go to the disk as a single command.  Data moves by bus-master DMA
+// when the disk sits on a PCI IDE controller that can do it (QEMU's
+// PIIX), so the CPU is not tied up copying it, and by programmed
+// I/O otherwise.
 
 #include "types.h"
 #include "defs.h"
@@ -12,27 +18,74 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "pci.h"
 
 #define SECTOR_SIZE   512
 #define IDE_BSY       0x80
 #define IDE_DRDY      0x40
 #define IDE_DF        0x20
+#define IDE_DRQ       0x08
 #define IDE_ERR       0x01
 
 #define IDE_CMD_READ  0x20
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+#define IDE_CMD_RDDMA 0xc8
+#define IDE_CMD_WRDMA 0xca
+#define IDE_CMD_IDENTIFY 0xec
 
-// idequeue points to the buf now being read/written to the disk.
-// idequeue->qnext points to the next buf to be processed.
-// You must hold idelock while manipulating queue.
+// Bus-master IDE registers, from the primary channel's base port.
+#define BM_CMD        0     // command
+#define BM_STATUS     2     // status
+#define BM_PRDT       4     // physical address of the PRD table
+#define BM_CMD_START  0x01  // start the transfer
+#define BM_CMD_READ   0x08  // direction: disk to memory
+#define BM_STATUS_ERR  0x02  // transfer failed (write 1 to clear)
+#define BM_STATUS_INTR 0x04  // disk interrupted (write 1 to clear)
+
+// Physical region descriptor: one piece of memory of a transfer.
+struct prd {
+  uint addr;            // physical address
+  ushort count;         // bytes, 0 means 64K
+  ushort flags;
+};
+#define PRD_EOT       0x8000  // last entry of the table
+
+#define IDE_MAXSECT   256  // most sectors one command can move
+
+// idequeue holds the bufs waiting for the disk, sorted by disk and
+// block number.  iderun is the chain (through qnext) of bufs for
+// consecutive blocks that the command in progress moves; idebuf is
+// the one the next sectors go to or come from, ideoff sectors into
+// it.  You must hold idelock while manipulating these.
 
 static struct spinlock idelock;
 static struct buf *idequeue;
+static struct buf *iderun;
+static struct buf *idebuf;
+static int ideoff;
+
+// The elevator (C-LOOK) starts each command at the first queued
+// block at or after where the last command ended, and wraps around
+// to the lowest queued block when there is none.
+static uint idenextdev, idenextblock;
 
 static int havedisk1;
-static void idestart(struct buf*);
+static void idestart(void);
+static void idecmd(void);
+static void ideidentify(int);
+static void idebminit(void);
+
+// Programmed I/O moves data with READ/WRITE MULTIPLE, which
+// interrupts once per idemult[dev] sectors instead of once per
+// sector.  Disks with idedma[dev] set use DMA instead, through the
+// bus-master registers at idebm with the descriptors in prdt.
+static int idemult[2];
+static int idedma[2];
+static uint idebm;
+static struct prd *prdt;
 
 // Wait for IDE disk to become ready.
 static int
@@ -67,35 +120,227 @@ ideinit(void)
 
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
+
+  idebminit();
+  ideidentify(0);
+  if(havedisk1)
+    ideidentify(1);
+}
+
+// Find the PCI IDE controller that the primary channel at 0x1f0
+// belongs to and turn on its bus mastering, if it has any.
+static void
+idebminit(void)
+{
+  uint tag, bar;
+
+  // Class 1 (storage), subclass 1 (IDE).
+  if(pcifind(PCI_CLASS, 0xffff0000, 0x01010000, &tag) < 0)
+    return;
+  // Programming interface bit 0 set: the primary channel is not
+  // at the legacy ports.  Bit 7 set: bus mastering.
+  if(pciread(tag, PCI_CLASS) & (1<<8) || !(pciread(tag, PCI_CLASS) & (1<<15)))
+    return;
+  bar = pciread(tag, PCI_BAR(4));
+  if(!(bar & PCI_BAR_IO) || (bar & PCI_BAR_IOMASK) == 0)
+    return;
+  if((prdt = (struct prd*)kalloc()) == 0)
+    return;
+  idebm = bar & PCI_BAR_IOMASK;
+  pciwrite(tag, PCI_CMD, (pciread(tag, PCI_CMD) & 0xffff) | PCI_CMD_IO | PCI_CMD_MASTER);
+}
+
+// Pick how disk dev moves data.  DMA if the controller and the
+// drive (IDENTIFY word 49 bit 8) can do it.  Otherwise, the number
+// of sectors per interrupt is set to a whole page (which is a whole
+// block), or as close to it as the drive allows: IDENTIFY word 47
+// holds its largest READ MULTIPLE block.  A drive without READ
+// MULTIPLE gets one sector at a time.
+// Polls, with disk interrupts off, since it runs during boot.
+static void
+ideidentify(int dev)
+{
+  ushort id[SECTOR_SIZE/2];
+  int max, n;
+
+  idemult[dev] = 1;
+  idedma[dev] = 0;
+  outb(0x3f6, 2);  // nIEN: no interrupt for these commands
+  outb(0x1f6, 0xe0 | (dev<<4));
+  idewait(0);
+  outb(0x1f7, IDE_CMD_IDENTIFY);
+  if(idewait(1) < 0 || (inb(0x1f7) & IDE_DRQ) == 0)
+    goto out;
+  insl(0x1f0, id, SECTOR_SIZE/4);
+  idedma[dev] = idebm != 0 && (id[49] & (1<<8)) != 0;
+
+  // The count must be a power of two.
+  max = id[47] & 0xff;
+  for(n = PGSIZE/SECTOR_SIZE; n > max; n /= 2)
+    ;
+  if(n > 1){
+    outb(0x1f2, n);
+    outb(0x1f7, IDE_CMD_SETMUL);
+    if(idewait(1) >= 0)
+      idemult[dev] = n;
+  }
+out:
+  outb(0x1f6, 0xe0 | (0<<4));
+  if(idedma[dev])
+    cprintf("ide: disk %d uses DMA\n", dev);
+  else
+    cprintf("ide: disk %d moves %d sectors per interrupt\n", dev, idemult[dev]);
+}
+
+// Sectors in a request for b.
+static int
+idensect(struct buf *b)
+{
+  // A page request (swap I/O) moves the whole page in one command.
+  return b->page ? PGSIZE/SECTOR_SIZE : BSIZE/SECTOR_SIZE;
+}
+
+// Sectors the next data transfer of the command in progress moves.
+// A block is a whole number of multiple blocks, so a transfer never
+// spans two bufs.
+static int
+idechunk(void)
+{
+  int n;
+
+  n = idensect(idebuf) - ideoff;
+  if(n > idemult[idebuf->dev&1])
+    n = idemult[idebuf->dev&1];
+  return n;
+}
+
+// Where the next sector of the command in progress goes.
+static uchar*
+idedata(void)
+{
+  return (idebuf->page ? idebuf->page : idebuf->data) + ideoff*SECTOR_SIZE;
+}
+
+// Account for n sectors moved, stepping to the next buf of the run
+// when this one is done.  idebuf is 0 once the whole run is.
+static void
+ideadvance(int n)
+{
+  ideoff += n;
+  if(ideoff == idensect(idebuf)){
+    idebuf = idebuf->qnext;
+    ideoff = 0;
+  }
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Does a come before b in the queue?
+static int
+idebefore(struct buf *a, struct buf *b)
+{
+  return a->dev < b->dev || (a->dev == b->dev && a->blockno < b->blockno);
+}
+
+// Block just past the end of b's request.
+static uint
+ideend(struct buf *b)
+{
+  return b->blockno + idensect(b)/(BSIZE/SECTOR_SIZE);
+}
+
+// Can b, which follows last in the queue, join last's command?
+// Both must go the same way, and b must start where last ends,
+// so a batch of swap pages in neighbouring slots is one command.
+static int
+idemerge(struct buf *last, struct buf *b, int nsect)
+{
+  return b->dev == last->dev && b->blockno == ideend(last) &&
+         (b->flags & B_DIRTY) == (last->flags & B_DIRTY) &&
+         nsect + idensect(b) <= IDE_MAXSECT;
+}
+
+// Start the next command: the buf the elevator picks, together with
+// the queued bufs for the blocks that follow it.
+// Caller must hold idelock.
 static void
-idestart(struct buf *b)
+idestart(void)
 {
-  if(b == 0)
+  struct buf **pp, *b, *last;
+  int nsect;
+
+  if(idequeue == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  for(pp = &idequeue; *pp; pp = &(*pp)->qnext)
+    if((*pp)->dev > idenextdev ||
+       ((*pp)->dev == idenextdev && (*pp)->blockno >= idenextblock))
+      break;
+  if(*pp == 0)
+    pp = &idequeue;
+
+  b = last = *pp;
+  nsect = idensect(b);
+  while(last->qnext && idemerge(last, last->qnext, nsect)){
+    last = last->qnext;
+    nsect += idensect(last);
+  }
+  *pp = last->qnext;
+  last->qnext = 0;
+  if(last->blockno >= FSSIZE+SWAPSIZE)
     panic("incorrect blockno");
-  int sector_per_block =  BSIZE/SECTOR_SIZE;
-  int sector = b->blockno * sector_per_block;
-  int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
-  int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
 
-  if (sector_per_block > 7) panic("idestart");
+  iderun = b;
+  idenextdev = b->dev;
+  idenextblock = ideend(last);
+  idecmd();
+}
+
+// Issue the command for iderun.  Caller must hold idelock.
+static void
+idecmd(void)
+{
+  struct buf *b, *p;
+  struct prd *d;
+  int sector, nsect, read, dma, multi;
+
+  b = iderun;
+  nsect = 0;
+  for(p = b; p; p = p->qnext)
+    nsect += idensect(p);
+  sector = b->blockno * (BSIZE/SECTOR_SIZE);
+  read = !(b->flags & B_DIRTY);
+  dma = idedma[b->dev&1];
+  multi = idemult[b->dev&1] > 1;
+  idebuf = b;
+  ideoff = 0;
+
+  if(dma){
+    // One descriptor per buf.  A buf never crosses a page, so it
+    // never crosses the 64K boundary a descriptor must not span.
+    d = prdt;
+    for(p = b; p; p = p->qnext, d++){
+      d->addr = V2P(p->page ? p->page : p->data);
+      d->count = idensect(p)*SECTOR_SIZE;
+      d->flags = p->qnext ? 0 : PRD_EOT;
+    }
+    outb(idebm + BM_CMD, 0);
+    outl(idebm + BM_PRDT, V2P(prdt));
+    outb(idebm + BM_STATUS, inb(idebm + BM_STATUS) | BM_STATUS_ERR | BM_STATUS_INTR);
+  }
 
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  outb(0x1f2, nsect & 0xff);  // number of sectors, 0 means 256
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
-  if(b->flags & B_DIRTY){
-    outb(0x1f7, write_cmd);
-    outsl(0x1f0, b->data, BSIZE/4);
+  if(dma){
+    outb(0x1f7, read ? IDE_CMD_RDDMA : IDE_CMD_WRDMA);
+    outb(idebm + BM_CMD, (read ? BM_CMD_READ : 0) | BM_CMD_START);
+  } else if(!read){
+    outb(0x1f7, multi ? IDE_CMD_WRMUL : IDE_CMD_WRITE);
+    outsl(0x1f0, idedata(), idechunk()*SECTOR_SIZE/4);
   } else {
-    outb(0x1f7, read_cmd);
+    outb(0x1f7, multi ? IDE_CMD_RDMUL : IDE_CMD_READ);
   }
 }
 
@@ -103,29 +348,67 @@ idestart(struct buf *b)
 void
 ideintr(void)
 {
-  struct buf *b;
+  struct buf *b, *next;
+  int n, st;
 
-  // First queued buffer is the active request.
   acquire(&idelock);
 
-  if((b = idequeue) == 0){
+  if((b = iderun) == 0){
     release(&idelock);
     return;
   }
-  idequeue = b->qnext;
 
-  // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
+  // A DMA command interrupts once, when it is done.  If it failed,
+  // the disk goes back to programmed I/O and the command is retried.
+  if(idedma[b->dev&1]){
+    st = inb(idebm + BM_STATUS);
+    outb(idebm + BM_CMD, 0);
+    outb(idebm + BM_STATUS, st | BM_STATUS_ERR | BM_STATUS_INTR);
+    if((st & BM_STATUS_ERR) || idewait(1) < 0){
+      cprintf("ide: DMA error on disk %d, using PIO\n", b->dev&1);
+      idedma[b->dev&1] = 0;
+      idecmd();
+      release(&idelock);
+      return;
+    }
+    goto done;
+  }
 
-  // Wake process waiting for this buf.
-  b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
-  wakeup(b);
+  // Otherwise each interrupt ends one transfer of idechunk()
+  // sectors: read them in, or count the ones written and send the
+  // next.  The command is done after the last one, or on an error.
+  if(idewait(1) >= 0){
+    if(!(b->flags & B_DIRTY)){
+      n = idechunk();
+      insl(0x1f0, idedata(), n*SECTOR_SIZE/4);
+      ideadvance(n);
+      if(idebuf){
+        release(&idelock);
+        return;
+      }
+    } else {
+      ideadvance(idechunk());
+      if(idebuf){
+        outsl(0x1f0, idedata(), idechunk()*SECTOR_SIZE/4);
+        release(&idelock);
+        return;
+      }
+    }
+  }
 
-  // Start disk on next buf in queue.
+done:
+  // Wake the processes waiting for the bufs of the run.
+  for(; b; b = next){
+    next = b->qnext;
+    b->flags |= B_VALID;
+    b->flags &= ~B_DIRTY;
+    wakeup(b);
+  }
+  iderun = 0;
+
+  // Start disk on the next command.
   if(idequeue != 0)
-    idestart(idequeue);
+    idestart();
 
   release(&idelock);
 }
@@ -137,32 +420,58 @@ ideintr(void)
 void
 iderw(struct buf *b)
 {
-  struct buf **pp;
+  iderwv(&b, 1);
+}
 
-  if(!holdingsleep(&b->lock))
-    panic("iderw: buf not locked");
-  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
-    panic("iderw: nothing to do");
-  if(b->dev != 0 && !havedisk1)
-    panic("iderw: ide disk 1 not present");
+// Sync n bufs of one disk, as iderw() does one.  They are all
+// queued before the first is waited for, so the elevator can sort
+// them and merge consecutive blocks into one command.  The file
+// system disk is the virtio one when there is one (see virtio.c).
+void
+iderwv(struct buf **bv, int n)
+{
+  struct buf **pp, *b;
+  int i;
+
+  if(n > 0 && bv[0]->dev == ROOTDEV && virtiodisk()){
+    virtiorw(bv, n);
+    return;
+  }
+
+  for(i = 0; i < n; i++){
+    b = bv[i];
+    if(b->dev != bv[0]->dev)
+      panic("iderw: mixed disks");
+    if(!holdingsleep(&b->lock))
+      panic("iderw: buf not locked");
+    if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
+      panic("iderw: nothing to do");
+    if(b->dev != 0 && !havedisk1)
+      panic("iderw: ide disk 1 not present");
+  }
 
   acquire(&idelock);  //DOC:acquire-lock
 
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
-    ;
-  *pp = b;
+  // Insert each buf into idequeue in block order.
+  for(i = 0; i < n; i++){
+    b = bv[i];
+    for(pp=&idequeue; *pp && !idebefore(b, *pp); pp=&(*pp)->qnext)  //DOC:insert-queue
+      ;
+    b->qnext = *pp;
+    *pp = b;
+  }
 
   // Start disk if necessary.
-  if(idequeue == b)
-    idestart(b);
+  if(iderun == 0)
+    idestart();
 
-  // Wait for request to finish.
-  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
-    sleep(b, &idelock);
+  // Wait for the requests to finish.
+  for(i = 0; i < n; i++){
+    b = bv[i];
+    while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
+      sleep(b, &idelock);
+    }
   }
 
-
   release(&idelock);
 }
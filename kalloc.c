@@ -8,8 +8,10 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "proc.h"
 
 void freerange(void *vstart, void *vend);
+static void kdrain(struct cpu*, int);
 extern char end[]; // first address after kernel loaded from ELF file
                    // defined by the kernel linker script in kernel.ld
 
@@ -17,12 +19,33 @@ struct run {
   struct run *next;
 };
 
+// Which user mapping a physical page backs, if any.
+// Used by the page replacement clock in proc.c.
+// pgdir and va are written without the lock by whoever owns
+// the page, so readers must check the mapping they find.
+// A page shared copy-on-write after fork() is mapped at the
+// same va by every sharer, but only one pgdir is recorded.
+struct frame {
+  int ref;        // number of page tables (or kernel users) of the page
+  pde_t *pgdir;
+  uint va;
+  uint swapslot;  // 1 + swap slot still holding a copy (swap cache), or 0
+  struct proc *owner;  // if the page is a page directory, its process
+};
+
 struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  int nfree;   // number of pages on freelist
+  struct frame frame[NFRAME];  // indexed by physical page number
 } kmem;
 
+// Free pages also sit in small per-CPU stacks (cpu->kmag), so
+// most kalloc() and kfree() calls touch only their own CPU's stack
+// with interrupts off.  kmem.lock is taken only to move KMAG/2 pages
+// at a time between a stack and the free list.
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
@@ -48,32 +71,112 @@ freerange(void *vstart, void *vend)
 {
   char *p;
   p = (char*)PGROUNDUP((uint)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
+    kmem.frame[V2P(p)/PGSIZE].ref = 1;
     kfree(p);
+  }
 }
 //PAGEBREAK: 21
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
+// Drop a reference to the page of physical memory pointed at
+// by v, freeing it with the last one.  v normally should have
+// been returned by a call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
 void
 kfree(char *v)
 {
   struct run *r;
+  struct frame *f;
+  struct cpu *c;
+  uint swapslot;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  f = &kmem.frame[V2P(v)/PGSIZE];
+  if(f->ref < 1)
+    panic("kfree: ref");
+  if(__sync_sub_and_fetch(&f->ref, 1) > 0)
+    return;
+
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
-  if(kmem.use_lock)
+  f->pgdir = 0;
+  f->owner = 0;
+  swapslot = 0;
+  if(f->swapslot){
     acquire(&kmem.lock);
-  r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  if(kmem.use_lock)
+    swapslot = f->swapslot;
+    f->swapslot = 0;
     release(&kmem.lock);
+  }
+
+  if(kmem.use_lock){
+    pushcli();
+    c = mycpu();
+    if(c->nkmag == KMAG)
+      kdrain(c, KMAG/2);
+    c->kmag[c->nkmag++] = v;
+    popcli();
+  } else {
+    r = (struct run*)v;
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+    kmem.nfree++;
+  }
+
+  // The swap cache copy is useless once the page is gone.
+  if(swapslot)
+    swapfree(swapslot - 1);
+}
+
+// Move n pages from c's stack to the free list.
+// Caller has interrupts off.
+static void
+kdrain(struct cpu *c, int n)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  while(n-- > 0 && c->nkmag > 0){
+    r = (struct run*)c->kmag[--c->nkmag];
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+    kmem.nfree++;
+  }
+  release(&kmem.lock);
+}
+
+// Move up to KMAG/2 pages from the free list to c's stack.
+// Caller has interrupts off.
+static void
+krefill(struct cpu *c)
+{
+  struct run *r;
+  int low;
+
+  acquire(&kmem.lock);
+  while(c->nkmag < KMAG/2 && (r = kmem.freelist) != 0){
+    kmem.freelist = r->next;
+    kmem.nfree--;
+    c->kmag[c->nkmag++] = (char*)r;
+  }
+  low = kmem.nfree < SWAPLOW;
+  release(&kmem.lock);
+
+  // Start reclaiming before the free list runs dry.
+  if(low)
+    wakeSwapOut();
+}
+
+// Give this CPU's cached pages back to the free list,
+// so processes waiting in kalloc() on other CPUs can use them.
+void
+kflush(void)
+{
+  pushcli();
+  kdrain(mycpu(), KMAG);
+  popcli();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -82,7 +185,25 @@ kfree(char *v)
 char*
 kalloc(void)
 {
+  struct cpu *c;
+  char *v;
+
+  if(kmem.use_lock){
+    pushcli();
+    c = mycpu();
+    if(c->nkmag == 0)
+      krefill(c);
+    if(c->nkmag > 0){
+      v = c->kmag[--c->nkmag];
+      popcli();
+      kmem.frame[V2P(v)/PGSIZE].ref = 1;
+      return v;
+    }
+    popcli();
+  }
 
+  // Still booting, or out of pages: take one from the free
+  // list, waiting for the swapout process to refill it.
   if(kmem.use_lock){
     acquire(&kmem.lock);
   }
@@ -105,13 +226,111 @@ kalloc(void)
 
   if (cur){
     kmem.freelist = cur->next;
+    kmem.nfree--;
   }
     
   if (kmem.use_lock) {
     release(&kmem.lock);
+    // Start reclaiming before the free list runs dry.
+    if (kmem.nfree < SWAPLOW)
+      wakeSwapOut();
   }
 
   char* char_cur = (char *)cur;
+  kmem.frame[V2P(char_cur)/PGSIZE].ref = 1;
   return char_cur;    
 }
 
+// Add a reference to the page at v (copy-on-write sharing).
+void
+kref(char *v)
+{
+  __sync_add_and_fetch(&kmem.frame[V2P(v)/PGSIZE].ref, 1);
+}
+
+// Number of references to the page at v.
+int
+krefcount(char *v)
+{
+  return kmem.frame[V2P(v)/PGSIZE].ref;
+}
+
+// Number of free pages, including the per-CPU stacks.
+// Read without the lock, so only good as a hint (e.g. for
+// the swapout watermarks).
+int
+kfreepages(void)
+{
+  int i, n;
+
+  n = kmem.nfree;
+  for(i = 0; i < ncpu; i++)
+    n += cpus[i].nkmag;
+  return n;
+}
+
+// Record that the page at v is mapped at user address va in pgdir.
+void
+frameset(char *v, pde_t *pgdir, uint va)
+{
+  struct frame *f = &kmem.frame[V2P(v)/PGSIZE];
+
+  f->pgdir = pgdir;
+  f->va = va;
+}
+
+// Look up the user mapping of physical page number i.
+// Returns 0 if the page is free or not a user page.
+// The answer may be stale; check that the PTE still maps page i.
+int
+frameget(uint i, pde_t **pgdir, uint *va)
+{
+  struct frame *f = &kmem.frame[i];
+
+  *pgdir = f->pgdir;
+  *va = f->va;
+  return *pgdir != 0;
+}
+
+// Record that page directory pgdir belongs to process p, so that
+// the owner of a user page can be found from the frame table
+// without a scan of the process table.
+void
+framesetowner(pde_t *pgdir, struct proc *p)
+{
+  kmem.frame[V2P(pgdir)/PGSIZE].owner = p;
+}
+
+// The process page directory pgdir was last recorded for, or 0.
+// The answer may be stale; check that p->pgdir is still pgdir.
+struct proc*
+frameowner(pde_t *pgdir)
+{
+  return kmem.frame[V2P(pgdir)/PGSIZE].owner;
+}
+
+// Remember that swap slot slot still holds an up to date
+// copy of the page at v, so a clean page need not be written
+// again when it is next evicted.
+void
+framesetslot(char *v, uint slot)
+{
+  acquire(&kmem.lock);
+  kmem.frame[V2P(v)/PGSIZE].swapslot = slot + 1;
+  release(&kmem.lock);
+}
+
+// Take over the swap cache slot of the page at v.
+// Returns the slot, or -1 if the page has none.
+int
+frametakeslot(char *v)
+{
+  struct frame *f = &kmem.frame[V2P(v)/PGSIZE];
+  int slot;
+
+  acquire(&kmem.lock);
+  slot = (int)f->swapslot - 1;
+  f->swapslot = 0;
+  release(&kmem.lock);
+  return slot;
+}
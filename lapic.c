@@ -41,6 +41,8 @@
 #define TCCR    (0x0390/4)   // Timer Current Count
 #define TDCR    (0x03E0/4)   // Timer Divide Configuration
 
+#define TICKCOUNT 10000000   // Bus cycles per timer tick
+
 volatile uint *lapic;  // Initialized in mp.c
 
 //PAGEBREAK!
@@ -66,7 +68,7 @@ lapicinit(void)
   // TICR would be calibrated using an external time source.
   lapicw(TDCR, X1);
   lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000);
+  lapicw(TICR, TICKCOUNT);
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -105,6 +107,64 @@ lapicid(void)
   return lapic[ID] >> 24;
 }
 
+// Stop the periodic tick and interrupt just once, n ticks from
+// now.  If n is 0, or too far off for the 32-bit counter, as far
+// ahead as it allows (about 429 ticks).
+void
+lapictickless(uint n)
+{
+  if(!lapic)
+    return;
+  if(n == 0 || n > 0xFFFFFFFF / TICKCOUNT)
+    n = 0xFFFFFFFF / TICKCOUNT;
+  lapicw(TIMER, T_IRQ0 + IRQ_TIMER);
+  lapicw(TICR, n * TICKCOUNT);
+}
+
+// Go back to ticking after lapictickless() and return the whole
+// ticks that have passed.  If it stopped part way through a tick,
+// the timer first runs one-shot to the end of that tick, and
+// lapictimer() restarts the periodic tick from there, so no time
+// is lost.
+uint
+lapictickresume(void)
+{
+  uint elapsed;
+
+  if(!lapic)
+    return 0;
+  elapsed = lapic[TICR] - lapic[TCCR];
+  if(elapsed % TICKCOUNT == 0){
+    lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+    lapicw(TICR, TICKCOUNT);
+  } else
+    lapicw(TICR, TICKCOUNT - elapsed % TICKCOUNT);
+  return elapsed / TICKCOUNT;
+}
+
+// Called on each timer interrupt outside tickless idle: restart
+// the periodic tick if lapictickresume() left the timer one-shot.
+void
+lapictimer(void)
+{
+  if(lapic && !(lapic[TIMER] & PERIODIC)){
+    lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+    lapicw(TICR, TICKCOUNT);
+  }
+}
+
+// Send interrupt vector vec to the CPU with local APIC id apicid.
+void
+lapicipi(int apicid, int vec)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | vec);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
 // Acknowledge interrupt.
 void
 lapiceoi(void)
@@ -51,10 +51,28 @@ iderw(struct buf *b)
 
   p = memdisk + b->blockno*BSIZE;
 
-  if(b->flags & B_DIRTY){
+  if(b->page){
+    if(b->blockno + PGSIZE/BSIZE > disksize)
+      panic("iderw: page out of range");
+    if(b->flags & B_DIRTY){
+      b->flags &= ~B_DIRTY;
+      memmove(p, b->page, PGSIZE);
+    } else
+      memmove(b->page, p, PGSIZE);
+  } else if(b->flags & B_DIRTY){
     b->flags &= ~B_DIRTY;
     memmove(p, b->data, BSIZE);
   } else
     memmove(b->data, p, BSIZE);
   b->flags |= B_VALID;
 }
+
+// Sync n bufs with disk.
+void
+iderwv(struct buf **bv, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    iderw(bv[i]);
+}
@@ -4,6 +4,7 @@
 
 // it is decreased from 0xE00000 to 0x400000 so as to increase page replacement rate
 #define PHYSTOP 0x400000           // Top physical memory
+#define NFRAME  (PHYSTOP/4096)      // Number of physical pages
 
 #define DEVSPACE 0xFE000000         // Other devices are at high addresses
 
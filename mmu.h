@@ -94,7 +94,16 @@ struct segdesc {
 #define PTE_P           0x001   // Present
 #define PTE_W           0x002   // Writeable
 #define PTE_U           0x004   // User
+#define PTE_A           0x020   // Accessed
+#define PTE_D           0x040   // Dirty
 #define PTE_PS          0x080   // Page Size
+#define PTE_COW         0x200   // Copy-on-write: shared read-only after fork
+
+// A user PTE whose page has been evicted has PTE_P clear and
+// PTE_SWAP set, and holds the swap slot number in place of
+// the physical page address.
+#define PTE_SWAP        0x080   // Page is in the swap area
+#define PTE_SLOT(pte)   ((uint)(pte) >> PTXSHIFT)
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
@@ -9,6 +9,18 @@
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       128*128*16  // size of file system in blocks
-#define QUANTA 		 5 //process preemption will be done every quanta size (measured inclock ticks) 
\ No newline at end of file
+#define LOGBATCH      8  // log blocks written to disk per request
+#define NBUF         (MAXOPBLOCKS*3)  // minimum size of disk block cache
+#define BCACHEFRAC   16  // disk block cache gets 1/BCACHEFRAC of the memory free at boot
+#define FSSIZE       32768  // size of file system in blocks (128 MB)
+#define SWAPSIZE     1024  // size of swap area in blocks, after the file system
+#define SWAPBATCH    16  // max pages evicted per swapout scan
+#define SWAPLOW       8  // kalloc() wakes the swapout process below this many free pages
+#define SWAPHIGH     32  // which then evicts until this many pages are free
+#define SWAPRA        2  // initial swap-in read-ahead window, in pages
+#define SWAPRAMAX    16  // largest read-ahead window (at most 32)
+#define NEXECSEG      4  // ELF segments per program that exec() loads on demand
+#define KMAG         16  // free pages cached per CPU by kalloc()
+#define QUANTA 		 5 //process preemption will be done every quanta size (measured inclock ticks) 
+#define CFSUNIT    1000  // CFS: vruntime a weight-1 process accrues per tick
+#define BOOSTTICKS  100  // DML: every process goes back to priority 3 this often
@@ -0,0 +1,57 @@
+// PCI configuration space access, through the I/O ports of
+// configuration mechanism #1.  Drivers find their device with
+// pcifind() and read its registers with pciread().
+
+#include "types.h"
+#include "defs.h"
+#include "x86.h"
+#include "pci.h"
+
+#define PCI_CONFADDR  0xcf8
+#define PCI_CONFDATA  0xcfc
+#define PCI_NBUS      256
+#define PCI_NDEV      32
+#define PCI_NFUNC     8
+
+// Read the 32-bit configuration register at off of function tag.
+uint
+pciread(uint tag, int off)
+{
+  outl(PCI_CONFADDR, 0x80000000 | tag | (off & 0xfc));
+  return inl(PCI_CONFDATA);
+}
+
+void
+pciwrite(uint tag, int off, uint val)
+{
+  outl(PCI_CONFADDR, 0x80000000 | tag | (off & 0xfc));
+  outl(PCI_CONFDATA, val);
+}
+
+// Find the first function whose register off, masked with mask,
+// equals val, and store its tag in *tagp.
+// Returns 0, or -1 if there is none.
+int
+pcifind(int off, uint mask, uint val, uint *tagp)
+{
+  int bus, dev, func;
+  uint tag;
+
+  for(bus = 0; bus < PCI_NBUS; bus++){
+    for(dev = 0; dev < PCI_NDEV; dev++){
+      for(func = 0; func < PCI_NFUNC; func++){
+        tag = PCITAG(bus, dev, func);
+        if((pciread(tag, PCI_ID) & 0xffff) == 0xffff){
+          if(func == 0)
+            break;  // no device in this slot
+          continue;
+        }
+        if((pciread(tag, off) & mask) == val){
+          *tagp = tag;
+          return 0;
+        }
+      }
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,20 @@
+// PCI configuration space.
+
+// A function is named by its tag: bus<<16 | device<<11 | function<<8.
+#define PCITAG(bus, dev, func)  (((bus)<<16) | ((dev)<<11) | ((func)<<8))
+
+// Configuration registers (byte offsets).
+#define PCI_ID        0x00  // device id<<16 | vendor id
+#define PCI_CMD       0x04  // command (low 16 bits), status
+#define PCI_CLASS     0x08  // class<<24 | subclass<<16 | prog if<<8 | revision
+#define PCI_BAR(n)    (0x10 + 4*(n))  // base address register n
+#define PCI_INTR      0x3c  // interrupt line (low byte)
+
+// Command register bits.
+#define PCI_CMD_IO    0x1   // respond to I/O space accesses
+#define PCI_CMD_MEM   0x2   // respond to memory space accesses
+#define PCI_CMD_MASTER 0x4  // may act as bus master (DMA)
+
+// An I/O space BAR has bit 0 set; the rest is the port base.
+#define PCI_BAR_IO    0x1
+#define PCI_BAR_IOMASK 0xfffffffc
@@ -6,772 +6,520 @@
 #include "mmu.h"
 #include "x86.h"
 #include "proc.h"
+#include "traps.h"
 #include "spinlock.h"
+#include "swapstat.h"
+#include "sched.h"
+#include "clock.h"
+
 #define NULL 0
 
-struct
-{
+struct swapqueue{
   struct spinlock lock;
-  struct proc proc[NPROC];
-} ptable;
-
-static struct proc *initproc;
-
-int nextpid = 1;
-extern void forkret(void);
-extern void trapret(void);
-
-static void wakeup1(void *chan);
+  int front;
+  int size;
+  int rear;
+  char* reqchan;
+  char* qchan;
+  struct proc* queue[NPROC+1];
+};
 
-void pinit(void)
-{
-  initlock(&ptable.lock, "ptable");
-}
+extern struct swapqueue swap_out_queue, swap_in_queue;
 
-// Must be called with interrupts disabled
-int cpuid()
-{
-  return mycpu() - cpus;
-}
+ typedef struct ptable_t {
+   struct spinlock lock;
+   struct proc proc[NPROC];
+ } ptable_dt;
 
-// Must be called with interrupts disabled to avoid the caller being
-// rescheduled between reading lapicid and running through the loop.
-struct cpu *
-mycpu(void)
-{
-  int apicid, i;
+// struct ptable_t {
+//   struct spinlock lock;
+//   struct proc proc[NPROC];
+// };
 
-  if (readeflags() & FL_IF)
-    panic("mycpu called with interrupts enabled\n");
+extern struct ptable_t ptable;
+extern void wakeup1(void *chan);
+static void runqput(struct proc*);
+static void wakeproc(struct proc*);
+static void runqdel(struct proc*);
+static void runqinit(void);
+static void setstate(struct proc*, enum procstate);
+static void groupplace(struct proc*);
 
-  apicid = lapicid();
-  // APIC IDs are not guaranteed to be contiguous. Maybe we should have
-  // a reverse map, or reserve a register to store &cpus[i].
-  for (i = 0; i < ncpu; ++i)
-  {
-    if (cpus[i].apicid == apicid)
-      return &cpus[i];
-  }
-  panic("unknown apicid\n");
-}
+struct swapqueue swap_out_queue, swap_in_queue; 
+int swapoutcount, swapincount, swapcleancount;
+struct swapstat swaptotal;   // System-wide, never reset
+int swaptrace = 1;           // Print a table row for every swap event
 
-// Disable interrupts so that we are not rescheduled
-// while reading proc from the cpu structure
-struct proc *
-myproc(void)
-{
-  struct cpu *c;
-  struct proc *p;
-  pushcli();
-  c = mycpu();
-  p = c->proc;
-  popcli();
-  return p;
-}
+// Writes a page into its swap slot
+void write_page(int pid, uint addr, uint slot, char *buf){
+  char my_pid[3], my_va[3];
+  int va = (int) addr;
 
-//PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
-// state required to run in the kernel.
-// Otherwise return 0.
-static struct proc *
-allocproc(void)
-{
-  struct proc *p;
-  char *sp;
+  my_pid[2] = 0;
+  my_pid[1] = '0' + pid % 10;
+  my_pid[0] = (pid / 10 ? '0' + pid / 10 : ' ');
 
-  acquire(&ptable.lock);
+  my_va[2] = 0;
+  my_va[1] = '0' + va%10;
+  my_va[0] = (va / 10 ? '0' + va / 10 : ' ');
 
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if (p->state == UNUSED)
-      goto found;
+  if(swaptrace)
+    cprintf("|       Page Swap Out       |  %s | %s |      Contents of page %s saved in swap slot %d\n", my_pid, my_va, my_va, slot);
 
-  release(&ptable.lock);
-  return 0;
+  swapwrite(slot, buf);          // Write the page into the swap area
+  swapoutcount++;
+  swaptotal.swapouts++;
+}
 
-found:
-  p->state = EMBRYO;
-  p->pid = nextpid++;
-  p->priority = 2;
-  p->ctime = ticks;
-  p->retime = 0;
-  p->rutime = 0;
-  p->stime = 0;
+// Reads the page in a swap slot into the buffer.  The slot
+// stays allocated as the page's swap cache copy.
+void read_page(int pid, uint addr, uint slot, char *buf){
+  swapread(slot, buf);           // Read the page into the buffer
+  swapincount++;
+  swaptotal.swapins++;
+}
 
-  release(&ptable.lock);
+// Enqueue function for the queues
+void enqueue(struct swapqueue* sq, struct proc* np){
+  if(sq->size == NPROC){
+    return;
+  } 
+  sq->rear = (sq->rear + 1) % NPROC;
+  sq->queue[sq->rear] = np; 
+  sq->size++;  
+}
 
-  // Allocate kernel stack.
-  if ((p->kstack = kalloc()) == 0)
-  {
-    p->state = UNUSED;
+// Dequeue function for the queues
+struct proc* dequeue(struct swapqueue* sq){
+  if (sq->size == 0){
     return 0;
-  }
-  sp = p->kstack + KSTACKSIZE;
-
-  // Leave room for trap frame.
-  sp -= sizeof *p->tf;
-  p->tf = (struct trapframe *)sp;
+  } 
 
-  // Set up new context to start executing at forkret,
-  // which returns to trapret.
-  sp -= 4;
-  *(uint *)sp = (uint)trapret;
+  struct proc* next = sq->queue[sq->front]; 
+  sq->front = (sq->front + 1) % NPROC; 
+  sq->size = sq->size - 1; 
 
-  sp -= sizeof *p->context;
-  p->context = (struct context *)sp;
-  memset(p->context, 0, sizeof *p->context);
-  p->context->eip = (uint)forkret;
+  if(sq->size == 0){
+    sq->front = 0;
+    sq->rear = NPROC - 1;
+  }
 
-  return p;
+  return next; 
 }
 
-//PAGEBREAK: 32
-// Set up first user process.
-void userinit(void)
+// If live process p maps physical page pa at va, set *ptep to
+// its PTE and return 1.
+static int
+mapsat(struct proc *p, uint va, uint pa, pte_t **ptep)
 {
-  struct proc *p;
-  extern char _binary_initcode_start[], _binary_initcode_size[];
-
-  p = allocproc();
-
-  initproc = p;
-  if ((p->pgdir = setupkvm()) == 0)
-    panic("userinit: out of memory?");
-  inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
-  p->sz = PGSIZE;
-  p->ctime = ticks;
-  p->priority = 2;
-  memset(p->tf, 0, sizeof(*p->tf));
-  p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
-  p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
-  p->tf->es = p->tf->ds;
-  p->tf->ss = p->tf->ds;
-  p->tf->eflags = FL_IF;
-  p->tf->esp = PGSIZE;
-  p->tf->eip = 0; // beginning of initcode.S
-
-  safestrcpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = namei("/");
-
-  // this assignment to p->state lets other cores
-  // run this process. the acquire forces the above
-  // writes to be visible, and the lock is also needed
-  // because the assignment might not be atomic.
-  acquire(&ptable.lock);
+  pte_t *pte;
 
-  p->state = RUNNABLE;
-
-  release(&ptable.lock);
+  if(p->state == UNUSED || p->state == EMBRYO)
+    return 0;
+  pte = (pte_t*)getpte(p->pgdir, (void *) va);
+  if(pte == 0 || !((*pte) & PTE_U) || !((*pte) & PTE_P) || PTE_ADDR(*pte) != pa)
+    return 0;
+  *ptep = pte;
+  return 1;
 }
 
-// Grow current process's memory by n bytes.
-// Return 0 on success, -1 on failure.
-int growproc(int n)
+// Returns a live process mapping physical page pa at va, and its
+// PTE, or 0.  Tries the owner of pgdir, the mapping recorded in the
+// frame table, first, which the frame table also gives directly.
+// Every process sharing a copy-on-write page maps it at the same
+// va, so if that one is gone another sharer can still be found
+// with a scan (and is recorded instead).
+// The ptable lock must be held.
+static struct proc*
+pagemapper(pde_t *pgdir, uint va, uint pa, pte_t **ptep)
 {
-  uint sz;
-  struct proc *curproc = myproc();
+  struct proc *p;
 
-  sz = curproc->sz;
-  if (n > 0)
-  {
-    if ((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
-      return -1;
-  }
-  else if (n < 0)
-  {
-    if ((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
-      return -1;
+  p = frameowner(pgdir);
+  if(p && p->pgdir == pgdir && mapsat(p, va, pa, ptep))
+    return p;
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->pgdir != pgdir && mapsat(p, va, pa, ptep)){
+      frameset(P2V(pa), p->pgdir, va);
+      return p;
+    }
   }
-  curproc->sz = sz;
-  switchuvm(curproc);
   return 0;
 }
 
-// Create a new process copying p as the parent.
-// Sets up stack to return as if from system call.
-// Caller must set state of returned proc to RUNNABLE.
-int fork(void)
-{
-  int i, pid;
-  struct proc *np;
-  struct proc *curproc = myproc();
-
-  // Allocate process.
-  if ((np = allocproc()) == 0)
-  {
-    return -1;
+// Writes the page mapped by pte at va in p out to a swap slot and
+// frees it.  A page still in the swap cache and not written since
+// it was swapped in is dropped without any I/O.
+// A page shared copy-on-write stays in memory for the other
+// sharers; p's PTE just takes a reference to its swap cache copy
+// (written first if there is none), which stays good because
+// shared pages are read-only.
+// Returns 0 if the swap area is full.
+// Drops and retakes swap_out_queue.lock and ptable.lock.
+int evictPage(struct proc *p, uint va, pte_t *pte){
+  char *mem = (char *)P2V(PTE_ADDR(*pte));
+  int slot = frametakeslot(mem);
+  int shared = krefcount(mem) > 1;
+  if(slot >= 0 && (shared || !((*pte) & PTE_D))){
+    if(shared){
+      swapdup(slot);
+      framesetslot(mem, slot);
+    }
+    *pte = (slot << PTXSHIFT) | (PTE_FLAGS(*pte) & ~PTE_P) | PTE_SWAP;
+    kfree(mem);
+    swapcleancount++;
+    swaptotal.cleandrops++;
+    p->ncleandrop++;
+    return 1;
   }
-
-  // Copy process state from proc.
-  if ((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0)
-  {
-    kfree(np->kstack);
-    np->kstack = 0;
-    np->state = UNUSED;
-    return -1;
+  // Processes that shared the page before it was last written
+  // may still have the old copy swapped out in this slot.
+  if(slot >= 0 && swapref(slot) > 1){
+    swapfree(slot);
+    slot = -1;
   }
-  np->sz = curproc->sz;
-  np->parent = curproc;
-  *np->tf = *curproc->tf;
+  if(slot < 0 && (slot = swapalloc()) < 0)        // Swap area is full
+    return 0;
+  // Keep p from running while the page is written: off the run
+  // queue if it is RUNNABLE, and if it is asleep, any wakeup is
+  // held back until the write is done (see wakeproc).  It keeps
+  // its state and channel.
+  int pid = p->pid;
+  if(p->rq)
+    runqdel(p);
+  p->evicting = 1;
+  p->wakepending = 0;
+  uint reqpte = *pte;
+  *pte = (slot << PTXSHIFT) | (PTE_FLAGS(*pte) & ~PTE_P) | PTE_SWAP;
 
-  // Clear %eax so that fork returns 0 in the child.
-  np->tf->eax = 0;
-  np->priority = myproc()->priority;
+  release(&swap_out_queue.lock);
+  release(&ptable.lock);
+  write_page(pid, va>>12, slot, (void *)P2V(PTE_ADDR(reqpte)));
+  acquire(&swap_out_queue.lock);
+  acquire(&ptable.lock);
 
-  for (i = 0; i < NOFILE; i++)
-    if (curproc->ofile[i])
-      np->ofile[i] = filedup(curproc->ofile[i]);
-  np->cwd = idup(curproc->cwd);
+  if(shared){
+    swapdup(slot);
+    framesetslot(mem, slot);
+  }
+  kfree((char *)P2V(PTE_ADDR(reqpte)));
+  p->nswapout++;
+  p->evicting = 0;
+  if(p->state == RUNNABLE)
+    runqput(p);
+  else if(p->state == SLEEPING && p->wakepending)
+    wakeproc(p);
+  p->wakepending = 0;
+  return 1;
+}
 
-  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+// Chooses up to n victim frames with the CLOCK algorithm and
+// evicts them.  The hand sweeps the physical frame table; a page
+// whose accessed bit is set gets a second chance (the bit is
+// cleared), and the first page found unreferenced is evicted.
+// Returns the number of pages evicted.
+int chooseVictimsAndEvict (int n){
+  static uint hand;   // only the swapout process evicts
+  int evicted = 0;
+  struct proc* p;
+  pde_t *pgdir;
+  pte_t *pte;
+  uint va;
+
+  // Two revolutions: the first may only clear accessed bits.
+  for(int i = 0; i < 2*NFRAME && evicted < n; i++, hand = (hand + 1) % NFRAME){
+    swaptotal.scanned++;
+    if(!frameget(hand, &pgdir, &va) || va < PGSIZE)
+      continue;
+    // Processes waiting for a free page may be in the middle
+    // of using their own pages (e.g. copyuvm), so leave them be.
+    p = pagemapper(pgdir, va, hand*PGSIZE, &pte);
+    if (p == 0 || p->state == RUNNING || p->state == ZOMBIE || p->pid < 5 || p->chan == swap_out_queue.reqchan)
+      continue;
+    if((*pte) & PTE_A){
+      *pte &= ~PTE_A;     // Second chance
+      continue;
+    }
+    if(!evictPage(p, va, pte))
+      break;
+    evicted++;
+  }
+  return evicted;
+}
 
-  pid = np->pid;
+// Entry point of the swapout process
+void swapoutprocess(){
+  sleep(swap_out_queue.qchan, &ptable.lock);
 
-  acquire(&ptable.lock);
+  while(1){
+    // cprintf("\n\nEntering swapout\n");
+    if(swaptrace)
+      cprintf("|      Swapout Resumes      |  -  | -  |   Swapout queue is non-empty => start execution   |\n");
+    acquire(&swap_out_queue.lock);
+    while(swap_out_queue.size || kfreepages() < SWAPLOW){
+      // Free enough pages for every waiting process and to refill
+      // the free list up to SWAPHIGH, all from one scan.
+      int n = SWAPHIGH - kfreepages();
+      if(n < swap_out_queue.size)
+        n = swap_out_queue.size;
+      if(n > SWAPBATCH)
+        n = SWAPBATCH;
+
+      int evicted = chooseVictimsAndEvict(n);
+      if(!evicted) // Edge case handling
+      {
+        if(!swap_out_queue.size)   // Nothing to evict and nobody waiting
+          break;
+        wakeup1(swap_out_queue.reqchan);
+        release(&swap_out_queue.lock);
+        release(&ptable.lock);
+        yield();
+        acquire(&swap_out_queue.lock);
+        acquire(&ptable.lock);
+        evicted = 1;  // Let the first waiter retry kalloc()
+      }
 
-  np->state = RUNNABLE;
+      // Each freed page satisfies one waiting process; they
+      // allocate from the free list, not from this CPU's cache.
+      kflush();
+      while(evicted-- > 0 && swap_out_queue.size){
+        struct proc *p = dequeue(&swap_out_queue);
+        p->satisfied = 1;
+      }
+    }
 
-  release(&ptable.lock);
+    wakeup1(swap_out_queue.reqchan);   // The the corresponding process
+    release(&swap_out_queue.lock);
+    sleep(swap_out_queue.qchan, &ptable.lock);
+  }
 
-  return pid;
 }
 
-// Exit the current process.  Does not return.
-// An exited process remains in the zombie state
-// until its parent calls wait() to find out it exited.
-void exit(void)
-{
-  struct proc *curproc = myproc();
-  struct proc *p;
-  int fd;
-
-  if (curproc == initproc)
-    panic("init exiting");
-
-  // Close all open files.
-  for (fd = 0; fd < NOFILE; fd++)
-  {
-    if (curproc->ofile[fd])
-    {
-      fileclose(curproc->ofile[fd]);
-      curproc->ofile[fd] = 0;
-    }
+// Fault-around for a swap-in at va: also bring in the next few
+// swapped-out pages of p, so a sequential scan takes one fault per
+// window instead of one per page.  The window doubles when the process
+// touched every page of the previous read-ahead and halves when it
+// touched fewer than half of them.  The whole window is read with
+// one batch of disk requests.
+// Called and returns with swap_in_queue.lock and ptable.lock held.
+// p is already running again, so each PTE is checked once more
+// before its page is mapped.
+static void readAhead(struct proc *p, uint va){
+  int i, n, hits;
+  uint a, pid;
+  uint idx[SWAPRAMAX], slot[SWAPRAMAX];
+  pte_t *pte, old[SWAPRAMAX];
+  char *mem[SWAPRAMAX];
+
+  n = hits = 0;
+  for(i = 0; i < SWAPRAMAX; i++){
+    if((p->ramask & (1 << i)) == 0)
+      continue;
+    n++;
+    pte = getpte(p->pgdir, (void *)(p->rastart + i*PGSIZE));
+    if(pte && (*pte & PTE_P) && (*pte & PTE_A))
+      hits++;
   }
-
-  begin_op();
-  iput(curproc->cwd);
-  end_op();
-  curproc->cwd = 0;
-
-  acquire(&ptable.lock);
-
-  // Parent might be sleeping in wait().
-  wakeup1(curproc->parent);
-
-  // Pass abandoned children to init.
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-  {
-    if (p->parent == curproc)
-    {
-      p->parent = initproc;
-      if (p->state == ZOMBIE)
-        wakeup1(initproc);
-    }
+  if(n > 0){
+    if(hits == n && p->rawindow < SWAPRAMAX)
+      p->rawindow *= 2;
+    else if(hits*2 < n && p->rawindow > 1)
+      p->rawindow /= 2;
+  }
+
+  pid = p->pid;
+  p->rastart = va + PGSIZE;
+  p->ramask = 0;
+  n = 0;
+  for(i = 0; i < p->rawindow; i++){
+    a = va + (i+1)*PGSIZE;
+    if(a >= p->sz)
+      break;
+    // Only read ahead into memory that is already free;
+    // never evict to make room for a guess.
+    if(kfreepages() <= SWAPLOW + n)
+      break;
+    pte = getpte(p->pgdir, (void *)a);
+    if(pte == 0 || (*pte & PTE_SWAP) == 0)
+      continue;
+    idx[n] = i;
+    old[n] = *pte;
+    slot[n] = PTE_SLOT(*pte);
+    n++;
   }
+  if(n == 0)
+    return;
 
-  // Jump into the scheduler, never to return.
-  curproc->state = ZOMBIE;
-  sched();
-  panic("zombie exit");
-}
-
-// Wait for a child process to exit and return its pid.
-// Return -1 if this process has no children.
-int wait(void)
-{
-  struct proc *p;
-  int havekids, pid;
-  struct proc *curproc = myproc();
-
+  release(&swap_in_queue.lock);
+  release(&ptable.lock);
+  for(i = 0; i < n; i++)
+    mem[i] = kalloc();
+  swapreadv(slot, mem, n);
+  swapincount += n;
+  swaptotal.swapins += n;
+  acquire(&swap_in_queue.lock);
   acquire(&ptable.lock);
-  for (;;)
-  {
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    {
-      if (p->parent != curproc)
-        continue;
-      havekids = 1;
-      if (p->state == ZOMBIE)
-      {
-        // Found one.
-        pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
-        release(&ptable.lock);
-        return pid;
-      }
-    }
 
-    // No point waiting if we don't have any children.
-    if (!havekids || curproc->killed)
-    {
-      release(&ptable.lock);
-      return -1;
+  for(i = 0; i < n; i++){
+    a = va + (idx[i]+1)*PGSIZE;
+    pte = p->pid == pid ? getpte(p->pgdir, (void *)a) : 0;
+    if(pte == 0 || *pte != old[i]){
+      // Exited, exec'd, or faulted the page in itself meanwhile.
+      kfree(mem[i]);
+      continue;
     }
-
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
-    sleep(curproc, &ptable.lock); //DOC: wait-sleep
+    swapInMap(p->pgdir, (void *)a, PGSIZE, V2P(mem[i]));
+    framesetslot(mem[i], slot[i]);
+    *pte &= ~PTE_A;   // so the next fault can tell whether it was used
+    p->ramask |= 1 << idx[i];
+    p->nswapin++;
   }
 }
 
-int waitstats(int *retime, int *rutime, int *stime, int *ctime)
-{
-  struct proc *p; // child process
-  int havekids, pid;
-  struct proc *curproc = myproc(); // parent process
-  acquire(&ptable.lock);
-  for (;;)
-  {
-    // find zombie children.
-    havekids = 0;
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    {
-      if (p->parent != curproc)
+// Entry point of the swapin process
+void swapinprocess(){
+  sleep(swap_in_queue.qchan, &ptable.lock);
+  while(1){
+    // cprintf("\n\nEntering swapin\n");
+    if(swaptrace)
+      cprintf("|      Swapin Resumes       |  -  | -  |   Swapin queue is non-empty => start execution    |\n");
+    acquire(&swap_in_queue.lock);
+    while(swap_in_queue.size){
+      struct proc *p = dequeue(&swap_in_queue);
+      uint va = PGROUNDDOWN(p->trapva);
+      pte_t *pte = getpte(p->pgdir, (void *)va);
+      if(pte == 0 || (*pte & PTE_SWAP) == 0){
+        // An earlier read-ahead already brought the page in.
+        wakeup1(p->chan);
         continue;
-      havekids = 1;
-      if (p->state == ZOMBIE)
-      { // child is zombie
-        // reset child and remove it from ptable
-        *retime = p->retime;
-        *rutime = p->rutime;
-        *stime = p->stime;
-        *ctime = p->ctime;
-        pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->state = UNUSED;
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->ctime = 0;
-        p->retime = 0;
-        p->rutime = 0;
-        p->stime = 0;
-        p->priority = 0;
-        release(&ptable.lock);
-        return pid;
       }
-    }
-    // Failed to find children.
-    if (!havekids || curproc->killed)
-    {
+      uint slot = PTE_SLOT(*pte);
+      release(&swap_in_queue.lock);
       release(&ptable.lock);
-      return -1;
-    }
-    // Wait for children to exit.
-    sleep(curproc, &ptable.lock);
-  }
-}
-
-#ifdef SML
-// Find the first process in ptable which is RUNNABLE and of highest priority
-struct proc *findmaxprio(int *i1, int *i2, int *i3, uint *priority)
-{
-  int i = 0;
-  struct proc *proc_find;
-again:
-  i = 0;
-  while (i != NPROC)
-  {
-    if (*priority == 1)
-    {
-      proc_find = &ptable.proc[(*i1 + i) % NPROC];
-      if (proc_find->state == RUNNABLE && proc_find->priority == *priority)
-      {
-        *i1 = *i1 + (1 + i);
-        *i1 = (*i1) % NPROC;
-        return proc_find; // found RUNNABLE with prio 1
-      }
-    }
-    else if (*priority == 2)
-    {
-      proc_find = &ptable.proc[(*i2 + i) % NPROC];
-      if (proc_find->state == RUNNABLE && proc_find->priority == *priority)
-      {
-        *i2 = *i2 + (1 + i);
-        *i2 = (*i2) % NPROC;
-        return proc_find; // found RUNNABLE with prio 2
-      }
-    }
-    else
-    {
-      proc_find = &ptable.proc[(*i3 + i) % NPROC];
-      if (proc_find->state == RUNNABLE && proc_find->priority == *priority)
-      {
-        *i3 = *i3 + (1 + i);
-        *i3 = (*i3) % NPROC;
-        return proc_find; // found RUNNABLE with prio 3
-      }
+      
+      char* mem = kalloc();
+      read_page(p->pid,((p->trapva)>>12),slot,mem);
+      
+      acquire(&swap_in_queue.lock);
+      acquire(&ptable.lock);
+      swapInMap(p->pgdir, (void *)va, PGSIZE, V2P(mem));
+      framesetslot(mem, slot);
+      // The page is about to be used; do not let CLOCK take it
+      // back before the process has run.
+      *getpte(p->pgdir, (void *)va) |= PTE_A;
+      p->nswapin++;
+      // Let p run while the rest of the window is read.
+      wakeup1(p->chan);
+      readAhead(p, va);
     }
-    i++;
-  }
-  if (*priority == 1)
-  { // No RUNNABLE found
-    *priority = 3;
-  }
-  else
-  {
-    *priority -= 1; // find RUNNABLE with lower prio
-    goto again;
+    // cprintf("\n\n");
+    release(&swap_in_queue.lock);
+    sleep(swap_in_queue.qchan, &ptable.lock);
   }
-  return 0;
-}
-#endif
 
-#ifdef DML
-// Find the first process in ptable which is RUNNABLE and of highest priority
-struct proc *findmaxprio(int *i1, int *i2, int *i3, uint *priority)
-{
-  int i = 0;
-  struct proc *proc_find;
-again:
-  i = 0;
-  while (i != NPROC)
-  {
-    if (*priority == 1)
-    {
-      proc_find = &ptable.proc[(*i1 + i) % NPROC];
-      if (proc_find->state == RUNNABLE && proc_find->priority == *priority)
-      {
-        *i1 = *i1 + (1 + i);
-        *i1 = (*i1) % NPROC;
-        return proc_find; // found RUNNABLE with prio 1
-      }
-    }
-    else if (*priority == 2)
-    {
-      proc_find = &ptable.proc[(*i2 + i) % NPROC];
-      if (proc_find->state == RUNNABLE && proc_find->priority == *priority)
-      {
-        *i2 = *i2 + (1 + i);
-        *i2 = (*i2) % NPROC;
-        return proc_find; // found RUNNABLE with prio 2
-      }
-    }
-    else
-    {
-      proc_find = &ptable.proc[(*i3 + i) % NPROC];
-      if (proc_find->state == RUNNABLE && proc_find->priority == *priority)
-      {
-        *i3 = *i3 + (1 + i);
-        *i3 = (*i3) % NPROC;
-        return proc_find; // found RUNNABLE with prio 3
-      }
-    }
-    i++;
-  }
-  if (*priority == 1)
-  { // No RUNNABLE found
-    *priority = 3;
-  }
-  else
-  {
-    *priority -= 1; // find RUNNABLE with lower prio
-    goto again;
-  }
-  return 0;
 }
-#endif
-
-//PAGEBREAK: 42
-// Per-CPU process scheduler.
-// Each CPU calls scheduler() after setting itself up.
-// Scheduler never returns.  It loops, doing:
-//  - choose a process to run
-//  - swtch to start running that process
-//  - eventually that process transfers control
-//      via swtch back to the scheduler.
-void scheduler(void)
-{
-  struct proc *p;
-  struct cpu *c = mycpu();
-  c->proc = 0;
-  int i1 = 0;
-  int i2 = 0;
-  int i3 = 0;
-
-  i1++;
-  i1--;
-  i3++;
-  i3--;
-  i2++;
-  i2--;
-
-  /*int x = i1;
-  i1 = x;
-  x = i2;
-  i2 = x;
-  x = i3;
-  i3 = x;*/
-  while (1)
-  {
-    // Enable interrupts on this processor.
-    sti();
-
-    acquire(&ptable.lock);
-#ifdef DEFAULT
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    {
-      if (p->state != RUNNABLE)
-        continue;
-
-      // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
-      // before jumping back to us.
-      c->proc = p;
-      switchuvm(p);
-      p->state = RUNNING;
-
-      // cprintf("PID: %d\tTick before exec: %d\n", p->pid, ticks);
-
-      p->ticks_elapsed = 0;
-      swtch(&(c->scheduler), p->context);
-      switchkvm();
-
-      // cprintf("       \tTick after exec : %d\n", ticks);
 
-      // Process is done running for now.
-      // It should have changed its p->state before coming back.
-      c->proc = 0;
-    }
-#else
 
-#ifdef FCFS
-    struct proc *min_prio_proc = NULL;
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    {
-      if (p->state == RUNNABLE)
-      {
-        if (min_prio_proc != NULL)
-        {
-          if (p->ctime < min_prio_proc->ctime)
-            min_prio_proc = p;
-        }
-        else
-          min_prio_proc = p;
-      }
-    }
-    if (min_prio_proc != NULL)
-    {
-      p = min_prio_proc; // process with smallest creation time
-      c->proc = p;
-      switchuvm(p);
-      p->state = RUNNING;
-
-      // cprintf("PID: %d\tTick before exec: %d\n", p->pid, ticks);
-      swtch(&(c->scheduler), p->context);
-      switchkvm();
-      // cprintf("       \tTick after exec : %d\n", ticks);
-
-      // proc completes it's execution and has changed it's state already
-      c->proc = 0;
-    }
-#else
-
-#ifdef SML
-    uint priority = 3;
-    p = findmaxprio(&i1, &i2, &i3, &priority);
-    if (p == 0)
-    {
-      release(&ptable.lock);
-      continue;
-    }
-    c->proc = p;
-    switchuvm(p);
-    p->state = RUNNING;
-
-    //  cprintf("PID: %d\tTick before exec: %d\n", p->pid, ticks);
-    swtch(&(c->scheduler), p->context);
-    switchkvm();
-    // cprintf("       \tTick after exec : %d\n", ticks);
-
-    c->proc = 0;
-#else
-
-#ifdef DML
-    uint priority = 3;
-    p = findmaxprio(&i1, &i2, &i3, &priority);
-    if (p == 0)
-    {
-      release(&ptable.lock);
-      continue;
-    }
-    c->proc = p;
-    switchuvm(p);
-    p->state = RUNNING;
-    p->ticks_elapsed = 0;
-    //  cprintf("PID: %d\tTick before exec: %d\n", p->pid, ticks);
-    swtch(&(c->scheduler), p->context);
-    switchkvm();
-    // cprintf("       \tTick after exec : %d\n", ticks);
-
-    c->proc = 0;
-#endif
-#endif
-#endif
-#endif
-    release(&ptable.lock);
-  }
-}
-
-// Enter scheduler.  Must hold only ptable.lock
-// and have changed p->state. Saves and restores
-// intena because intena is a property of this
-// kernel thread, not this CPU. It should
-// be p->intena and p->ncli, but that would
-// break in the few places where a lock is held but
-// there's no process.
-void sched(void)
-{
-  int intena;
-  struct proc *p = myproc();
-
-  if (!holding(&ptable.lock))
-    panic("sched ptable.lock");
-  if (mycpu()->ncli != 1)
-    panic("sched locks");
-  if (p->state == RUNNING)
-    panic("sched running");
-  if (readeflags() & FL_IF)
-    panic("sched interruptible");
-  intena = mycpu()->intena;
-  swtch(&p->context, mycpu()->scheduler);
-  mycpu()->intena = intena;
-}
+// Submits a request for a free page to the swapout process
+void submitReqToSwapOut(){
+  struct proc* p = myproc();
+  // cprintf("submitReqToSwapOut %d\n",p->pid);
+  char my_pid[3];
+  my_pid[1] = '0' + p->pid%10;
+  my_pid[0] = (p->pid/10 ? '0' + p->pid/10 : ' ');
+  my_pid[2] = 0;
+  if(swaptrace)
+    cprintf("| Submit Request to SwapOut |  %s | -  |         Process %s is queued to swapout           |\n", my_pid, my_pid);
 
-// Give up the CPU for one scheduling round.
-void yield(void)
-{
-  acquire(&ptable.lock); //DOC: yieldlock
-  myproc()->state = RUNNABLE;
-  sched();
-  release(&ptable.lock);
-}
+  acquire(&ptable.lock);
+  uint start = ticks;
+  acquire(&swap_out_queue.lock);
+  p->satisfied = 0;
+  enqueue(&swap_out_queue, p);   // Enqueues the process in the Swapout queue
+  wakeup1(swap_out_queue.qchan); // Wakes up the Swapout process
+  release(&swap_out_queue.lock);
 
-// A fork child's very first scheduling by scheduler()
-// will swtch here.  "Return" to user space.
-void forkret(void)
-{
-  static int first = 1;
-  // Still holding ptable.lock from scheduler.
+  while(p->satisfied==0)  // Sleep process till not satisfied 
+    sleep(swap_out_queue.reqchan, &ptable.lock);
+  p->swapwait += ticks - start;
+  swaptotal.waitticks += ticks - start;
   release(&ptable.lock);
-
-  if (first)
-  {
-    // Some initialization functions must be run in the context
-    // of a regular process (e.g., they call sleep), and thus cannot
-    // be run from main().
-    first = 0;
-    iinit(ROOTDEV);
-    initlog(ROOTDEV);
-  }
-
-  // Return to "caller", actually trapret (see allocproc).
+  return;
 }
 
-// Atomically release lock and sleep on chan.
-// Reacquires lock when awakened.
-void sleep(void *chan, struct spinlock *lk)
-{
-  struct proc *p = myproc();
-
-  if (p == 0)
-    panic("sleep");
-
-  if (lk == 0)
-    panic("sleep without lk");
-
-  // Must acquire ptable.lock in order to
-  // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
-  // so it's okay to release lk.
-  if (lk != &ptable.lock)
-  {                        //DOC: sleeplock0
-    acquire(&ptable.lock); //DOC: sleeplock1
-    release(lk);
-  }
-  // Go to sleep.
-  p->chan = chan;
-  p->state = SLEEPING;
-
-  sched();
-
-  // Tidy up.
-  p->chan = 0;
-
-  // Reacquire original lock.
-  if (lk != &ptable.lock)
-  { //DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
+// Wakes the swapout process to refill the free list in the
+// background.  Called by kalloc() below SWAPLOW free pages;
+// the caller must not hold ptable.lock.
+void wakeSwapOut(){
+  if(swap_out_queue.qchan == 0)   // Swapout process not set up yet
+    return;
+  wakeup(swap_out_queue.qchan);
 }
 
-//PAGEBREAK!
-// Wake up all processes sleeping on chan (chan is a channel).
-// The ptable lock must be held.
-static void
-wakeup1(void *chan)
-{
-  struct proc *p;
+// Submits a request to the swapin process
+void submitReqToSwapIn(){
+  struct proc* p = myproc();
+  // cprintf("submitReqToSwapIn %d\n",p->pid);
+  char my_pid[3];
+  my_pid[1] = '0' + p->pid%10;
+  my_pid[0] = (p->pid/10 ? '0' + p->pid/10 : ' ');
+  my_pid[2] = 0;
+  if(swaptrace)
+    cprintf("| Submit Request to SwapIn  |  %s | -  |         Process %s is queued to swapin            |\n", my_pid, my_pid);
 
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if (p->state == SLEEPING && p->chan == chan)
-    {
-      p->state = RUNNABLE;
-#ifdef DML
-      p->priority = 3; // Set priority to 3 (Max value) when process returns from I/O
-#endif
-    }
+  acquire(&ptable.lock);
+  p->nfault++;
+  swaptotal.faults++;
+  acquire(&swap_in_queue.lock); 
+    enqueue(&swap_in_queue, p);   // Enqueues the process in the Swapin queue
+    wakeup1(swap_in_queue.qchan); // Wake up the Swapin process
+  release(&swap_in_queue.lock);
+  
+  sleep((char *)p->pid, &ptable.lock);  // Suspend the process
+  release(&ptable.lock);
+  return;
 }
 
-// Wake up all processes sleeping on chan.
-void wakeup(void *chan)
+// On exit of a process run from sh, report the swap counts,
+// unless swaptrace is off.
+// Swap slots themselves are released by freevm().
+void printSwapStats()
 {
   acquire(&ptable.lock);
-  wakeup1(chan);
+  if(swaptrace){
+    cprintf("--------------------------------------------------------------------------------------------\n");
+    cprintf("\nTotal no. of Swap in: %d\nTotal no. of Swap out: %d\nTotal no. of clean pages dropped: %d\n\n", swapincount, swapoutcount, swapcleancount);
+  }
+  swapincount = swapoutcount = swapcleancount = 0;
   release(&ptable.lock);
 }
 
-// Kill the process with the given pid.
-// Process won't exit until it returns
-// to user space (see trap in trap.c).
-int kill(int pid)
+// Copy the swap counts of process pid, or the system-wide
+// totals if pid is 0, to *st.  Returns -1 if there is no
+// such process.  *st is user memory, which may fault (and so
+// need ptable.lock), so it is written after the lock is dropped.
+int getswapstats(int pid, struct swapstat *st)
 {
   struct proc *p;
+  struct swapstat s;
 
   acquire(&ptable.lock);
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-  {
-    if (p->pid == pid)
-    {
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if (p->state == SLEEPING)
-        p->state = RUNNABLE;
+  if(pid == 0){
+    s = swaptotal;
+    release(&ptable.lock);
+    *st = s;
+    return 0;
+  }
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != UNUSED && p->pid == pid){
+      s.faults = p->nfault;
+      s.swapins = p->nswapin;
+      s.swapouts = p->nswapout;
+      s.cleandrops = p->ncleandrop;
+      s.scanned = 0;
+      s.waitticks = p->swapwait;
       release(&ptable.lock);
+      *st = s;
       return 0;
     }
   }
@@ -779,1091 +527,1043 @@ int kill(int pid)
   return -1;
 }
 
-//PAGEBREAK: 36
-// Print a process listing to console.  For debugging.
-// Runs when user types ^P on console.
-// No lock to avoid wedging a stuck machine further.
-void procdump(void)
+// Turn the per-event swap trace on or off.
+// Returns the previous setting.
+int setswaptrace(int on)
 {
-  static char *states[] = {
-      [UNUSED] "unused",
-      [EMBRYO] "embryo",
-      [SLEEPING] "sleep ",
-      [RUNNABLE] "runble",
-      [RUNNING] "run   ",
-      [ZOMBIE] "zombie"};
-  int i;
-  struct proc *p;
-  char *state;
-  uint pc[10];
+  int old = swaptrace;
 
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-  {
-    if (p->state == UNUSED)
-      continue;
-    if (p->state >= 0 && p->state < NELEM(states) && states[p->state])
-      state = states[p->state];
-    else
-      state = "???";
-    cprintf("%d %s %s", p->pid, state, p->name);
-    if (p->state == SLEEPING)
-    {
-      getcallerpcs((uint *)p->context->ebp + 2, pc);
-      for (i = 0; i < 10 && pc[i] != 0; i++)
-        cprintf(" %p", pc[i]);
-    }
-    cprintf("\n");
-  }
+  swaptrace = on;
+  return old;
 }
 
-#include <stdbool.h>
-#include "types.h"
-#include "defs.h"
-#include "param.h"
-#include "memlayout.h"
-#include "mmu.h"
-#include "x86.h"
-#include "proc.h"
-#include "spinlock.h"
-#include "sleeplock.h"
-#include "fs.h"
-#include "file.h"
-#include "stat.h"
-#include "fcntl.h"
-
-#define NULL 0
-
-struct swapqueue{
-  struct spinlock lock;
-  int front;
-  int size;
-  int rear;
-  char* reqchan;
-  char* qchan;
-  struct proc* queue[NPROC+1];
-};
+static struct proc *initproc;
+ptable_dt ptable;
 
-extern struct swapqueue swap_out_queue, swap_in_queue;
+int nextpid = 1;
+extern void forkret(void);
+extern void trapret(void);
+extern void wakeup1(void*);
 
-struct victim
+void
+pinit(void)
 {
-  pte_t* pte;
-  struct proc* pr;
-  uint va; 
-};
-
-extern int flimit;
-
- typedef struct ptable_t {
-   struct spinlock lock;
-   struct proc proc[NPROC];
- } ptable_dt;
-
-// struct ptable_t {
-//   struct spinlock lock;
-//   struct proc proc[NPROC];
-// };
-
-extern struct ptable_t ptable;
-extern void wakeup1(void *chan);
-
-struct swapqueue swap_out_queue, swap_in_queue; 
-int flimit = 2; 
-int swapoutcount, swapincount;
+  initlock(&ptable.lock, "ptable");
+  initlock(&swap_out_queue.lock, "swap_out_queue");
+  initlock(&swap_in_queue.lock, "swap_in_queue");
+  runqinit();
+}
 
-// Inbuilt function to allocate fd
+// Must be called with interrupts disabled
 int
-fdalloc(struct file *f)
-{
-  int fd;
-  struct proc *curproc = myproc();
+cpuid() {
+  return mycpu()-cpus;
+}
 
-  for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd] == 0){
-      curproc->ofile[fd] = f;
-      return fd;
-    }
+// Must be called with interrupts disabled to avoid the caller being
+// rescheduled between reading lapicid and running through the loop.
+struct cpu*
+mycpu(void)
+{
+  int apicid, i;
+  
+  if(readeflags()&FL_IF)
+    panic("mycpu called with interrupts enabled\n");
+  
+  apicid = lapicid();
+  // APIC IDs are not guaranteed to be contiguous. Maybe we should have
+  // a reverse map, or reserve a register to store &cpus[i].
+  for (i = 0; i < ncpu; ++i) {
+    if (cpus[i].apicid == apicid)
+      return &cpus[i];
   }
-  return -1;
+  panic("unknown apicid\n");
+}
+
+// Disable interrupts so that we are not rescheduled
+// while reading proc from the cpu structure
+struct proc*
+myproc(void) {
+  struct cpu *c;
+  struct proc *p;
+  pushcli();
+  c = mycpu();
+  p = c->proc;
+  popcli();
+  return p;
 }
 
-// Inbuilt function to create a file with given name
-struct inode*
-create(char *path, short type, short major, short minor)  
+// Claim the UNUSED slot p for a new process: give it a pid and the
+// scheduling and accounting state every process starts with.
+// Caller must hold ptable.lock.
+static void
+procfresh(struct proc *p)
 {
-  struct inode *ip, *dp;
-  char name[DIRSIZ];
-
-  if((dp = nameiparent(path, name)) == 0)
-    return 0;
-  ilock(dp);
-
-  if((ip = dirlookup(dp, name, 0)) != 0){
-    iunlockput(dp);
-    ilock(ip);
-    if(type == T_FILE && ip->type == T_FILE)
-      return ip;
-    iunlockput(ip);
-    return 0;
-  }
+  p->state = EMBRYO;
+  p->pid = nextpid++;
+  p->priority = 2;
+  p->ctime = ticks;
+  p->retime = 0;
+  p->rutime = 0;
+  p->stime = 0;
+  p->nsretime = p->nsrutime = p->nsstime = 0;
+  p->cpu = -1;
+  p->group = 0;
+  p->rawindow = SWAPRA;
+  p->ramask = 0;
+  p->nfault = p->nswapin = p->nswapout = p->ncleandrop = p->swapwait = 0;
+}
 
-  if((ip = ialloc(dp->dev, type)) == 0)
-    panic("create: ialloc");
-
-  ilock(ip);
-  ip->major = major;
-  ip->minor = minor;
-  ip->nlink = 1;
-  iupdate(ip);
-
-  if(type == T_DIR){  // Create . and .. entries.
-    dp->nlink++;  // for ".."
-    iupdate(dp);
-    // No ip->nlink++ for ".": avoid cyclic ref count.
-    if(dirlink(ip, ".", ip->inum) < 0 || dirlink(ip, "..", dp->inum) < 0)
-      panic("create dots");
-  }
+//PAGEBREAK: 32
+// Look in the process table for an UNUSED proc.
+// If found, change state to EMBRYO and initialize
+// state required to run in the kernel.
+// Otherwise return 0.
+static struct proc*
+allocproc(void)
+{
+  struct proc *p;
+  char *sp;
 
-  if(dirlink(dp, name, ip->inum) < 0)
-    panic("create: dirlink");
+  acquire(&ptable.lock);
 
-  iunlockput(dp);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->state == UNUSED)
+      goto found;
 
-  return ip;
-}
+  release(&ptable.lock);
+  return 0;
 
-// Inbuilt function to open a file
-int open_file(char *path, int omode) {  
-  int fd;
-  struct file *f;
-  struct inode *ip;
+found:
+  procfresh(p);
 
-  begin_op();
+  release(&ptable.lock);
 
-  if(omode & O_CREATE){
-    ip = create(path, T_FILE, 0, 0);
-    if(ip == 0){
-      end_op();
-      return -1;
-    }
-  } else {
-    if((ip = namei(path)) == 0){
-      end_op();
-      return -1;
-    }
-    ilock(ip);
-    if(ip->type == T_DIR && omode != O_RDONLY){
-      iunlockput(ip);
-      end_op();
-      return -1;
-    }
+  // Allocate kernel stack.
+  if((p->kstack = kalloc()) == 0){
+    p->state = UNUSED;
+    return 0;
   }
+  sp = p->kstack + KSTACKSIZE;
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
-    iunlockput(ip);
-    end_op();
-    return -1;
-  }
-  iunlock(ip);
-  end_op();
+  // Leave room for trap frame.
+  sp -= sizeof *p->tf;
+  p->tf = (struct trapframe*)sp;
 
-  f->type = FD_INODE;
-  f->ip = ip;
-  f->off = 0;
-  f->readable = !(omode & O_WRONLY);
-  f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
-  strncpy(f->name, path, 14);
-  return fd;
-}
+  // Set up new context to start executing at forkret,
+  // which returns to trapret.
+  sp -= 4;
+  *(uint*)sp = (uint)trapret;
 
+  sp -= sizeof *p->context;
+  p->context = (struct context*)sp;
+  memset(p->context, 0, sizeof *p->context);
+  p->context->eip = (uint)forkret;
 
-// Create name string from
-// PID and VA[32:13].
-// Will return PID_VA[32:13] as the name
-void
-get_name(int pid, uint addr, char *name) {
-  int i = 0;
-  while (pid) {
-    name[i++] = '0' + (pid%10);
-    pid = pid / 10;
-  } 
-  name[i++] = '_';
-  if(addr==0){
-    name[i++]='0';
-  }
-  while (addr) {
-    name[i++] = '0' + (addr%10);
-    addr = addr / 10;
-  }
-  name[i++] = '.';
-  name[i++] = 's';
-  name[i++] = 'w';
-  name[i++] = 'p';
-  name[i] = 0;
-  i -=4;
-  int mi = -1;
-  for(int j=0;j<i;j++){
-    if(name[j]=='_') {
-      mi=j;break;
-    }
-  }
-  char temp;
-  for(int j=0;j<mi/2;j++){
-    temp = name[j];
-    name[j] = name[mi-j-1];
-    name[mi-j-1] = temp;
-  }
-  for(int j=mi+1, k=i-1;j<k;j++,k--){
-    temp = name[j];
-    name[j] = name[k];
-    name[k] = temp;
-  }
+  return p;
 }
 
-// Writes a page into the swapout file
-int write_page(int pid, uint addr, char *buf){
-  flimit++;
-  char name[14];
+//PAGEBREAK: 32
+// Set up first user process.
+void
+userinit(void)
+{
+  struct proc *p;
+  extern char _binary_initcode_start[], _binary_initcode_size[];
 
-  get_name(pid, addr, name);
-  
-  int fd = open_file(name, O_CREATE|O_WRONLY);  // Open + create file 
-  struct file *f;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
-    return -1;
+  p = allocproc();
   
-  // cprintf("Creating page file: %s\n", name);
-  char my_pid[3], my_va[3];
-  int va = (int) addr;
-
-  my_pid[2] = 0;
-  my_pid[1] = '0' + pid % 10;
-  my_pid[0] = (pid / 10 ? '0' + pid / 10 : ' ');
+  initproc = p;
+  if((p->pgdir = setupkvm()) == 0)
+    panic("userinit: out of memory?");
+  framesetowner(p->pgdir, p);
+  inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
+  p->sz = PGSIZE;
+  p->ctime = ticks;
+  p->priority = 2;
+  memset(p->tf, 0, sizeof(*p->tf));
+  p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
+  p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
+  p->tf->es = p->tf->ds;
+  p->tf->ss = p->tf->ds;
+  p->tf->eflags = FL_IF;
+  p->tf->esp = PGSIZE;
+  p->tf->eip = 0;  // beginning of initcode.S
 
-  my_va[2] = 0;
-  my_va[1] = '0' + va%10;
-  my_va[0] = (va / 10 ? '0' + va / 10 : ' ');
+  safestrcpy(p->name, "initcode", sizeof(p->name));
+  p->cwd = namei("/");
 
-  if (my_va[0] == ' ')
-    cprintf("|    Page File Creation     |  %s | %s |      Contents of page %s saved in %s        |\n", my_pid, my_va, my_va, name);
-  else
-    cprintf("|    Page File Creation     |  %s | %s |      Contents of page %s saved in %s       |\n", my_pid, my_va, my_va, name);
+  // this assignment to p->state lets other cores
+  // run this process. the acquire forces the above
+  // writes to be visible, and the lock is also needed
+  // because the assignment might not be atomic.
+  acquire(&ptable.lock);
+    setstate(p, RUNNABLE);
+    runqput(p);
+  release(&ptable.lock);
 
-  int noc = filewrite(f, buf, 4096);          // Write the page in the file
-  if (noc < 0){
-    cprintf("Unable to write. Exiting (paging.c::write_page)!!");
-  }
+  acquire(&swap_out_queue.lock);
+    swap_out_queue.qchan = (void*)0xA8080;
+    swap_out_queue.reqchan = (void*)0xA8000;
+    swap_out_queue.front = 0;
+    swap_out_queue.rear = NPROC - 1;
+    swap_out_queue.size = 0; 
+  release(&swap_out_queue.lock);
 
-  swapoutcount++;
-  return noc;
+  acquire(&swap_in_queue.lock);
+    swap_in_queue.qchan = (void*)0xB8081;
+    swap_in_queue.reqchan = (void*)0xB8001;
+    swap_in_queue.front = 0;
+    swap_in_queue.rear = NPROC - 1;
+    swap_in_queue.size = 0; 
+  release(&swap_in_queue.lock);
 }
 
-// Deletes swapout file with the given filename
+// Grow current process's memory by n bytes.
+// Return 0 on success, -1 on failure.
 int
-delete_page(char* path)
+growproc(int n)
 {
-  struct inode *ip, *dp;
-  struct dirent de;
-  char name[DIRSIZ];
-  uint off;
-
-  begin_op();
-  dp = nameiparent(path, name);
-
-  ilock(dp);
-
-  if(namecmp(name, ".") == 0 || namecmp(name, "..") == 0)
-    goto bad;
-
-  if((ip = dirlookup(dp, name, &off)) == 0)
-    goto bad;
-  ilock(ip);
-
-  if(ip->nlink < 1)
-    panic("unlink: nlink < 1");
+  uint sz;
+  struct proc *curproc = myproc();
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
-  if(ip->type == T_DIR){
-    dp->nlink--;
-    iupdate(dp);
+  sz = curproc->sz;
+  if(n > 0){
+    // Pages are allocated on first touch; see lazyfault().
+    if(sz + n < sz || sz + n >= KERNBASE)
+      return -1;
+    sz += n;
+  } else if(n < 0){
+    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+      return -1;
   }
-  iunlockput(dp);
-
-  ip->nlink--;
-  iupdate(ip);
-  iunlockput(ip);
-
-  end_op();
-
+  curproc->sz = sz;
+  switchuvm(curproc);
   return 0;
-
-bad:
-  iunlockput(dp);
-  end_op();
-  return -1;
 }
 
-// Reads the swapout file into the buffer 
-int read_page(int pid, uint addr, char *buf){
-  char name[14];
+// Create a new process copying p as the parent.
+// Sets up stack to return as if from system call.
+// Caller must set state of returned proc to RUNNABLE.
+int
+fork(void)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *curproc = myproc();
 
-  get_name(pid, addr, name);
-  int fd = open_file(name, O_RDONLY);   // Open swapout page file
-  struct file *f;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  // Allocate process.
+  if((np = allocproc()) == 0){
     return -1;
-  int noc = fileread(f, buf, 4096);     // Read the page into the buffer
-  if(noc < 0){
-    cprintf("Unable to write. Exiting (paging.c::read_page)!!");
   }
-  swapincount++;
-  delete_page(name);
-  myproc()->ofile[fd] = 0;
-  fileclose(f);
-
-  return noc;
-}
-
-// Enqueue function for the queues
-void enqueue(struct swapqueue* sq, struct proc* np){
-  if(sq->size == NPROC){
-    return;
-  } 
-  sq->rear = (sq->rear + 1) % NPROC;
-  sq->queue[sq->rear] = np; 
-  sq->size++;  
-}
-
-// Dequeue function for the queues
-struct proc* dequeue(struct swapqueue* sq){
-  if (sq->size == 0){
-    return 0;
-  } 
-
-  struct proc* next = sq->queue[sq->front]; 
-  sq->front = (sq->front + 1) % NPROC; 
-  sq->size = sq->size - 1; 
 
-  if(sq->size == 0){
-    sq->front = 0;
-    sq->rear = NPROC - 1;
+  // Copy process state from proc.
+  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
   }
+  framesetowner(np->pgdir, np);
+  np->sz = curproc->sz;
+  np->parent = curproc;
+  *np->tf = *curproc->tf;
 
-  return next; 
-}
+  // Clear %eax so that fork returns 0 in the child.
+  np->tf->eax = 0;
+  np->priority = myproc()->priority;
+  np->vruntime = curproc->vruntime;
+  np->group = curproc->group;
 
-// Chooses a victim frame using LRU and evicts it 
-int chooseVictimAndEvict (int pid){
-  struct proc* p;
-  struct victim victims[4] = {{0,0,0},{0,0,0},{0,0,0},{0,0,0}};
-  pde_t *pte;
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if (p->state == UNUSED || p->state == EMBRYO || p->state == RUNNING || p->pid < 5 || p->pid == pid)
-        continue;
-      
-      for(uint i = PGSIZE; i < p->sz; i += PGSIZE){
-        pte = (pte_t*)getpte(p->pgdir, (void *) i);
-        if( !((*pte) & PTE_U) || !((*pte) & PTE_P) )
-          continue;
-        int idx =(((*pte)&(uint)96)>>5);
-        if(idx>0&&idx<3)
-          idx=3-idx;
-        victims[idx].pte = pte;
-        victims[idx].va = i;
-        victims[idx].pr = p;
-      }
-  }
-  for(int i=0;i<4;i++)
-  {
-    if(victims[i].pte != 0)
-    {
-      pte = victims[i].pte;
-      int origstate = victims[i].pr->state;
-      char* origchan = victims[i].pr->chan;
-      victims[i].pr->state = SLEEPING;
-      victims[i].pr->chan = 0;
-      uint reqpte = *pte;
-      *pte = ((*pte)&(~PTE_P));
-      *pte = *pte | ((uint)1<<7);
-      
-      if(victims[i].pr->state != ZOMBIE){
-        release(&swap_out_queue.lock);
-        release(&ptable.lock);
-        write_page(victims[i].pr->pid, (victims[i].va)>>12, (void *)P2V(PTE_ADDR(reqpte)));   
-        acquire(&swap_out_queue.lock);
-        acquire(&ptable.lock);
-      }
-      kfree((char *)P2V(PTE_ADDR(reqpte)));
-      lcr3(V2P(victims[i].pr->pgdir)); 
-      victims[i].pr->state = origstate;
-      victims[i].pr->chan = origchan;
-      return 1;
-    }
-  }
-  return 0;
-}
+  for(i = 0; i < NOFILE; i++)
+    if(curproc->ofile[i])
+      np->ofile[i] = filedup(curproc->ofile[i]);
+  np->cwd = idup(curproc->cwd);
+  np->exe = curproc->exe ? idup(curproc->exe) : 0;
+  memmove(np->seg, curproc->seg, sizeof(curproc->seg));
 
-// Entry point of the swapout process
-void swapoutprocess(){
-  sleep(swap_out_queue.qchan, &ptable.lock);
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
-  while(1){
-    // cprintf("\n\nEntering swapout\n");
-    cprintf("|      Swapout Resumes      |  -  | -  |   Swapout queue is non-empty => start execution   |\n");
-    acquire(&swap_out_queue.lock);
-    while(swap_out_queue.size){
-      while (flimit >= NOFILE)    // Edge case handling
-      {
-        cprintf("flimit \n");
-        wakeup1(swap_out_queue.reqchan);
-        release(&swap_out_queue.lock);
-        release(&ptable.lock);
-        yield();
-        acquire(&swap_out_queue.lock);
-        acquire(&ptable.lock);
-      }
-      
-      struct proc *p = dequeue(&swap_out_queue); // Dequeue process from queue
-      
-      if(!chooseVictimAndEvict(p->pid)) // Edge case handling
-      {
-        wakeup1(swap_out_queue.reqchan);
-        release(&swap_out_queue.lock);
-        release(&ptable.lock);
-        yield();
-        acquire(&swap_out_queue.lock);
-        acquire(&ptable.lock);
-      }
-      p->satisfied = 1;     // When frame found set satified to true
-    }
+  pid = np->pid;
 
-    wakeup1(swap_out_queue.reqchan);   // The the corresponding process
-    release(&swap_out_queue.lock);
-    sleep(swap_out_queue.qchan, &ptable.lock);
-  }
+  acquire(&ptable.lock);
+
+  setstate(np, RUNNABLE);
+  groupplace(np);
+  runqput(np);
+
+  release(&ptable.lock);
 
+  return pid;
 }
 
-// Entry point of the swapin process
-void swapinprocess(){
-  sleep(swap_in_queue.qchan, &ptable.lock);
-  while(1){
-    // cprintf("\n\nEntering swapin\n");
-    cprintf("|      Swapin Resumes       |  -  | -  |   Swapin queue is non-empty => start execution    |\n");
-    acquire(&swap_in_queue.lock);
-    while(swap_in_queue.size){
-      struct proc *p = dequeue(&swap_in_queue);
-      flimit--;
-      release(&swap_in_queue.lock);
-      release(&ptable.lock);
-      
-      char* mem = kalloc();
-      read_page(p->pid,((p->trapva)>>12),mem);
-      
-      acquire(&swap_in_queue.lock);
-      acquire(&ptable.lock);
-      swapInMap(p->pgdir, (void *)PGROUNDDOWN(p->trapva), PGSIZE, V2P(mem));
-      wakeup1(p->chan);
+// Exit the current process.  Does not return.
+// An exited process remains in the zombie state
+// until its parent calls wait() to find out it exited.
+void
+exit(void)
+{
+  struct proc *curproc = myproc();
+  struct proc *p;
+
+  if(curproc == initproc)
+    panic("init exiting");
+
+  // Close all open files.
+  for(int fd = 0; fd < NOFILE; fd++){
+    if(curproc->ofile[fd]){
+      fileclose(curproc->ofile[fd]);
+      curproc->ofile[fd] = 0;
     }
-    // cprintf("\n\n");
-    release(&swap_in_queue.lock);
-    sleep(swap_in_queue.qchan, &ptable.lock);
   }
 
-}
-
+  if(curproc->parent && curproc->parent->pid == 4){ 
+    // process run on sh
+    printSwapStats();
+  }
 
-// Submits a request for a free page to the swapout process
-void submitReqToSwapOut(){
-  struct proc* p = myproc();
-  // cprintf("submitReqToSwapOut %d\n",p->pid);
-  char my_pid[3];
-  my_pid[1] = '0' + p->pid%10;
-  my_pid[0] = (p->pid/10 ? '0' + p->pid/10 : ' ');
-  my_pid[2] = 0;
-  cprintf("| Submit Request to SwapOut |  %s | -  |         Process %s is queued to swapout           |\n", my_pid, my_pid);
+  begin_op();
+  iput(curproc->cwd);
+  if(curproc->exe)
+    iput(curproc->exe);
+  end_op();
+  curproc->cwd = 0;
+  curproc->exe = 0;
 
   acquire(&ptable.lock);
-  acquire(&swap_out_queue.lock);
-  p->satisfied = 0;
-  enqueue(&swap_out_queue, p);   // Enqueues the process in the Swapout queue
-  wakeup1(swap_out_queue.qchan); // Wakes up the Swapout process
-  release(&swap_out_queue.lock);
 
-  while(p->satisfied==0)  // Sleep process till not satisfied 
-    sleep(swap_out_queue.reqchan, &ptable.lock);
-  release(&ptable.lock);
-  return;
-}
+  // Parent might be sleeping in wait().
+  wakeup1(curproc->parent);
 
-// Submits a request to the swapin process
-void submitReqToSwapIn(){
-  struct proc* p = myproc();
-  // cprintf("submitReqToSwapIn %d\n",p->pid);
-  char my_pid[3];
-  my_pid[1] = '0' + p->pid%10;
-  my_pid[0] = (p->pid/10 ? '0' + p->pid/10 : ' ');
-  my_pid[2] = 0;
-  cprintf("| Submit Request to SwapIn  |  %s | -  |         Process %s is queued to swapin            |\n", my_pid, my_pid);
+  // Pass abandoned children to init.
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->parent == curproc){
+      p->parent = initproc;
+      if(p->state == ZOMBIE)
+        wakeup1(initproc);
+    }
+  }
 
-  acquire(&ptable.lock);
-  acquire(&swap_in_queue.lock); 
-    enqueue(&swap_in_queue, p);   // Enqueues the process in the Swapin queue
-    wakeup1(swap_in_queue.qchan); // Wake up the Swapin process
-  release(&swap_in_queue.lock);
+  // Jump into the scheduler, never to return.
+  setstate(curproc, ZOMBIE);
+  sched();
+  panic("zombie exit");
+}
+
+// Wait for a child process to exit and return its pid.
+// Return -1 if this process has no children.
+int
+wait(void)
+{
+  struct proc *p;
+  int havekids, pid;
+  struct proc *curproc = myproc();
   
-  sleep((char *)p->pid, &ptable.lock);  // Suspend the process
-  release(&ptable.lock);
-  return;
+  acquire(&ptable.lock);
+  for(;;){
+    // Scan through table looking for exited children.
+    havekids = 0;
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(p->parent != curproc)
+        continue;
+      havekids = 1;
+      if(p->state == ZOMBIE){
+        // Found one.
+        pid = p->pid;
+        kfree(p->kstack);
+        p->kstack = 0;
+        freevm(p->pgdir);
+        p->pid = 0;
+        p->parent = 0;
+        p->name[0] = 0;
+        p->killed = 0;
+        p->state = UNUSED;
+        release(&ptable.lock);
+        return pid;
+      }
+    }
+
+    // No point waiting if we don't have any children.
+    if(!havekids || curproc->killed){
+      release(&ptable.lock);
+      return -1;
+    }
+
+    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
+    sleep(curproc, &ptable.lock);  //DOC: wait-sleep
+  }
 }
 
-// On exit delete the swapout page-files created 
-void deleteSwapoutPageFiles()
+// Like wait(), also returning the child's times: in ticks, and
+// to the nanosecond in *pt if pt is not 0.
+int waitstats(int *retime, int *rutime, int *stime, int *ctime, struct proctimes *pt)
 {
+  struct proc *p; // child process
+  int havekids, pid;
+  int re, ru, s, c;
+  struct proctimes t;
+  struct proc *curproc = myproc(); // parent process
   acquire(&ptable.lock);
-  struct proc *p;
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)  
+  for (;;)
   {
-    if(p->state == UNUSED) continue;
-    if(p->pid==2||p->pid==3)
+    // find zombie children.
+    havekids = 0;
+    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
     {
-      for(int fd = 0; fd < NOFILE; fd++){
-        if(p->ofile[fd]){
-          struct file* f;
-          f = p->ofile[fd];
-
-          if(f->ref < 1) {
-            p->ofile[fd] = 0;
-            continue;
-          }
-          release(&ptable.lock);
-          // if(f->ref == 1) cprintf("Deleting page file: %s\n", f->name);
-          if(f->ref == 1) {
-            int i = 0, k = 0;
-            for(i = 0; i < 14; i ++) if(f->name[i] == '_') break;
-            for(k = 0; k < 14; k ++) if(f->name[k] == '.') break;
-            char my_pid[3], my_va[3];
-            my_pid[0] = (i == 2 ? f->name[i-2] : ' ');
-            my_pid[1] = f->name[i-1];
-            my_pid[2] = 0;
-            i++;
-            my_va[0] = (k-i == 2 ? f->name[k-2] : ' ');
-            my_va[1] = f->name[k-1];
-            my_va[2] = 0;
-            if(my_va[0] == ' ')
-              cprintf("|    Page File Deletion     |  %s | %s |           Page file %s is deleted           |\n", my_pid, my_va, f->name);
-            else
-              cprintf("|    Page File Deletion     |  %s | %s |           Page file %s is deleted          |\n", my_pid, my_va, f->name);
-          }
-          delete_page(p->ofile[fd]->name);
-          fileclose(f);
-          flimit--;
-          p->ofile[fd] = 0;
-
-          acquire(&ptable.lock);
-        }
+      if (p->parent != curproc)
+        continue;
+      havekids = 1;
+      if (p->state == ZOMBIE)
+      { // child is zombie
+        // reset child and remove it from ptable
+        re = p->retime;
+        ru = p->rutime;
+        s = p->stime;
+        c = p->ctime;
+        nstotimespec(p->nsretime, &t.retime);
+        nstotimespec(p->nsrutime, &t.rutime);
+        nstotimespec(p->nsstime, &t.stime);
+        pid = p->pid;
+        kfree(p->kstack);
+        p->kstack = 0;
+        freevm(p->pgdir);
+        p->state = UNUSED;
+        p->pid = 0;
+        p->parent = 0;
+        p->name[0] = 0;
+        p->killed = 0;
+        p->ctime = 0;
+        p->retime = 0;
+        p->rutime = 0;
+        p->stime = 0;
+        p->priority = 0;
+        release(&ptable.lock);
+        // User memory may fault, which needs ptable.lock.
+        *retime = re;
+        *rutime = ru;
+        *stime = s;
+        *ctime = c;
+        if (pt)
+          *pt = t;
+        return pid;
       }
     }
+    // Failed to find children.
+    if (!havekids || curproc->killed)
+    {
+      release(&ptable.lock);
+      return -1;
+    }
+    // Wait for children to exit.
+    sleep(curproc, &ptable.lock);
   }
-  cprintf("--------------------------------------------------------------------------------------------\n");
-  cprintf("\nTotal no. of Swap in: %d\nTotal no. of Swap out: %d\n\n", swapincount, swapoutcount);
-  swapincount = swapoutcount = 0;
-  release(&ptable.lock);
 }
 
-static struct proc *initproc;
-ptable_dt ptable;
+//PAGEBREAK: 42
+// Run queues.
+// Each CPU has its own queue of RUNNABLE processes, so picking
+// the next process never scans the process table.  A process is
+// put on a queue whenever it becomes RUNNABLE (userinit, fork,
+// yield, wakeup1, kill) and taken off when a CPU picks it.
+// Each queue has its own lock, so CPUs picking from or stealing
+// between different queues do not contend.  ptable.lock is taken
+// only for changes to p->state, so a process is put on a queue or
+// picked to run with both locks held (in that order), but a steal
+// moves a process from one queue to another with just the two
+// queue locks, taken in queue order.  With ptable.lock held p->rq
+// is zero or not for good, though a steal may change which queue
+// it is.  An idle CPU checks the queues without any lock.
+//
+// A process goes back on the queue of the CPU it last ran on, to
+// find its cache and TLB state still warm; only new processes go
+// to the shortest queue.  A CPU whose own queue is empty steals
+// from the busiest one (see runqsteal).
+//
+// How a queue is ordered is up to the active scheduling class
+// (see below).  Each queue has one FIFO per priority level, used
+// by the FIFO classes, and a min-heap ordered by virtual runtime,
+// used by CFS.
+#define NRQLEVEL 3
+
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NRQLEVEL];
+  struct proc *tail[NRQLEVEL];
+  struct proc *heap[NPROC];    // heap[0] has the least vruntime
+  uint minvruntime;            // vruntime of the last process picked
+  volatile int n;              // Processes on the queue
+};
 
-int nextpid = 1;
-extern void forkret(void);
-extern void trapret(void);
-extern void wakeup1(void*);
+static struct runq runq[NCPU];
+
+// A scheduling class: the hooks that make up one policy.
+// enqueue, dequeue, pick and steal are called with rq->lock
+// held; runqput and runqdel keep rq->n and p->rq themselves.
+// tick runs in the timer interrupt for the current process,
+// without the lock, and only touches that process.  Hooks other
+// than enqueue, dequeue and pick may be 0.
+struct schedclass {
+  void (*enqueue)(struct runq*, struct proc*);  // Add p to rq
+  void (*dequeue)(struct runq*, struct proc*);  // Remove p from rq
+  struct proc* (*pick)(struct runq*);           // Next to run, or 0
+  struct proc* (*steal)(struct runq*);          // Best to migrate, or 0
+  int (*tick)(struct proc*);                    // Nonzero to preempt
+  void (*yield)(struct proc*);                  // p gives up the CPU
+  void (*wakeup)(struct proc*);                 // p wakes from sleep
+};
 
-void
-pinit(void)
+// FIFO classes.  p goes at the tail of its level, or, with
+// sorted set, after every process created before it.
+static void
+fifoinsert(struct runq *rq, struct proc *p, int l, int sorted)
 {
-  initlock(&ptable.lock, "ptable");
-  initlock(&swap_out_queue.lock, "swap_out_queue");
-  initlock(&swap_in_queue.lock, "swap_in_queue");
+  struct proc *q = rq->tail[l];
+
+  while(sorted && q && q->ctime > p->ctime)
+    q = q->rqprev;
+  p->rqlevel = l;
+  p->rqprev = q;
+  p->rqnext = q ? q->rqnext : rq->head[l];
+  if(p->rqnext)
+    p->rqnext->rqprev = p;
+  else
+    rq->tail[l] = p;
+  if(q)
+    q->rqnext = p;
+  else
+    rq->head[l] = p;
 }
 
-// Must be called with interrupts disabled
-int
-cpuid() {
-  return mycpu()-cpus;
+static void
+rrenqueue(struct runq *rq, struct proc *p)
+{
+  fifoinsert(rq, p, 0, 0);
 }
 
-// Must be called with interrupts disabled to avoid the caller being
-// rescheduled between reading lapicid and running through the loop.
-struct cpu*
-mycpu(void)
+static void
+fcfsenqueue(struct runq *rq, struct proc *p)
 {
-  int apicid, i;
-  
-  if(readeflags()&FL_IF)
-    panic("mycpu called with interrupts enabled\n");
-  
-  apicid = lapicid();
-  // APIC IDs are not guaranteed to be contiguous. Maybe we should have
-  // a reverse map, or reserve a register to store &cpus[i].
-  for (i = 0; i < ncpu; ++i) {
-    if (cpus[i].apicid == apicid)
-      return &cpus[i];
-  }
-  panic("unknown apicid\n");
+  fifoinsert(rq, p, 0, 1);
 }
 
-// Disable interrupts so that we are not rescheduled
-// while reading proc from the cpu structure
-struct proc*
-myproc(void) {
-  struct cpu *c;
-  struct proc *p;
-  pushcli();
-  c = mycpu();
-  p = c->proc;
-  popcli();
-  return p;
+static void
+prioenqueue(struct runq *rq, struct proc *p)
+{
+  if(p->priority < 1 || p->priority > NRQLEVEL)
+    panic("prioenqueue: priority");
+  fifoinsert(rq, p, p->priority - 1, 0);
 }
 
-//PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
-// state required to run in the kernel.
-// Otherwise return 0.
+static void
+fifodequeue(struct runq *rq, struct proc *p)
+{
+  int l = p->rqlevel;
+
+  if(p->rqprev)
+    p->rqprev->rqnext = p->rqnext;
+  else
+    rq->head[l] = p->rqnext;
+  if(p->rqnext)
+    p->rqnext->rqprev = p->rqprev;
+  else
+    rq->tail[l] = p->rqprev;
+  p->rqnext = p->rqprev = 0;
+}
+
+// The head of the highest non-empty level.
+static struct proc*
+fifopick(struct runq *rq)
+{
+  int l;
+
+  for(l = NRQLEVEL-1; l >= 0; l--)
+    if(rq->head[l])
+      return rq->head[l];
+  return 0;
+}
+
+// The tail of the highest non-empty level: the process that
+// would wait longest.
 static struct proc*
-allocproc(void)
+fifosteal(struct runq *rq)
 {
-  struct proc *p;
-  char *sp;
+  int l;
 
-  acquire(&ptable.lock);
+  for(l = NRQLEVEL-1; l >= 0; l--)
+    if(rq->tail[l])
+      return rq->tail[l];
+  return 0;
+}
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == UNUSED)
-      goto found;
+// DEFAULT: round robin, QUANTA ticks each.
+static int
+rrtick(struct proc *p)
+{
+  return ++p->ticks_elapsed >= QUANTA;
+}
 
-  release(&ptable.lock);
-  return 0;
+// SML: round robin within the highest priority, a tick each.
+static int
+smltick(struct proc *p)
+{
+  return 1;
+}
 
-found:
-  p->state = EMBRYO;
-  p->pid = nextpid++;
-  p->priority = 2;
-  p->ctime = ticks;
-  p->retime = 0;
-  p->rutime = 0;
-  p->stime = 0;
+// DML: ticks a process may run at each priority before it is
+// demoted: the lower the priority, the longer the slice.  A
+// process that wakes from sleep goes back to the top, and
+// boost_prio() lifts everyone there every BOOSTTICKS ticks.
+static int dmlquanta[NRQLEVEL] = { 4*QUANTA, 2*QUANTA, QUANTA };
 
-  release(&ptable.lock);
+// p's slice at its current priority.
+static int
+dmlquantum(struct proc *p)
+{
+  if(p->priority < 1 || p->priority > NRQLEVEL)
+    panic("dml: priority");
+  return dmlquanta[p->priority - 1];
+}
 
-  // Allocate kernel stack.
-  if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
-    return 0;
-  }
-  sp = p->kstack + KSTACKSIZE;
+static int
+dmltick(struct proc *p)
+{
+  return ++p->ticks_elapsed >= dmlquantum(p);
+}
 
-  // Leave room for trap frame.
-  sp -= sizeof *p->tf;
-  p->tf = (struct trapframe*)sp;
+static void
+dmlyield(struct proc *p)
+{
+  if(p->ticks_elapsed >= dmlquantum(p) && p->priority > 1)
+    p->priority--;
+}
 
-  // Set up new context to start executing at forkret,
-  // which returns to trapret.
-  sp -= 4;
-  *(uint*)sp = (uint)trapret;
+static void
+dmlwakeup(struct proc *p)
+{
+  p->priority = 3;
+}
 
-  sp -= sizeof *p->context;
-  p->context = (struct context*)sp;
-  memset(p->context, 0, sizeof *p->context);
-  p->context->eip = (uint)forkret;
+// CFS: a process's share of the CPU is proportional to the weight
+// of its priority (see set_prio).  Each tick charges the running
+// process CFSUNIT/weight of virtual runtime, and each CPU runs the
+// process with the least.
+static uint cfsweight[NRQLEVEL] = { 1, 2, 4 };  // by priority-1
 
-  return p;
+static int
+vless(struct proc *a, struct proc *b)
+{
+  return (int)(a->vruntime - b->vruntime) < 0;
 }
 
-//PAGEBREAK: 32
-// Set up first user process.
-void
-userinit(void)
+static void
+heapswap(struct runq *rq, int i, int j)
 {
-  struct proc *p;
-  extern char _binary_initcode_start[], _binary_initcode_size[];
+  struct proc *p = rq->heap[i];
 
-  p = allocproc();
-  
-  initproc = p;
-  if((p->pgdir = setupkvm()) == 0)
-    panic("userinit: out of memory?");
-  inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
-  p->sz = PGSIZE;
-  p->ctime = ticks;
-  p->priority = 2;
-  memset(p->tf, 0, sizeof(*p->tf));
-  p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
-  p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
-  p->tf->es = p->tf->ds;
-  p->tf->ss = p->tf->ds;
-  p->tf->eflags = FL_IF;
-  p->tf->esp = PGSIZE;
-  p->tf->eip = 0;  // beginning of initcode.S
+  rq->heap[i] = rq->heap[j];
+  rq->heap[j] = p;
+  rq->heap[i]->rqidx = i;
+  rq->heap[j]->rqidx = j;
+}
 
-  safestrcpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = namei("/");
+// Restore heap order around slot i.
+static void
+heapfix(struct runq *rq, int i)
+{
+  int c;
 
-  // this assignment to p->state lets other cores
-  // run this process. the acquire forces the above
-  // writes to be visible, and the lock is also needed
-  // because the assignment might not be atomic.
-  acquire(&ptable.lock);
-    p->state = RUNNABLE;
-  release(&ptable.lock);
+  while(i > 0 && vless(rq->heap[i], rq->heap[(i-1)/2])){
+    heapswap(rq, i, (i-1)/2);
+    i = (i-1)/2;
+  }
+  for(;;){
+    c = 2*i + 1;
+    if(c >= rq->n)
+      break;
+    if(c+1 < rq->n && vless(rq->heap[c+1], rq->heap[c]))
+      c++;
+    if(!vless(rq->heap[c], rq->heap[i]))
+      break;
+    heapswap(rq, i, c);
+    i = c;
+  }
+}
 
-  acquire(&swap_out_queue.lock);
-    swap_out_queue.qchan = (void*)0xA8080;
-    swap_out_queue.reqchan = (void*)0xA8000;
-    swap_out_queue.front = 0;
-    swap_out_queue.rear = NPROC - 1;
-    swap_out_queue.size = 0; 
-  release(&swap_out_queue.lock);
+static void
+cfsenqueue(struct runq *rq, struct proc *p)
+{
+  // A process that slept (or is new) gets at most one tick of
+  // credit, rather than the whole time it was away.
+  if((int)(p->vruntime - (rq->minvruntime - CFSUNIT)) < 0)
+    p->vruntime = rq->minvruntime - CFSUNIT;
+  p->rqidx = rq->n - 1;
+  rq->heap[p->rqidx] = p;
+  heapfix(rq, p->rqidx);
+}
 
-  acquire(&swap_in_queue.lock);
-    swap_in_queue.qchan = (void*)0xB8081;
-    swap_in_queue.reqchan = (void*)0xB8001;
-    swap_in_queue.front = 0;
-    swap_in_queue.rear = NPROC - 1;
-    swap_in_queue.size = 0; 
-  release(&swap_in_queue.lock);
+static void
+cfsdequeue(struct runq *rq, struct proc *p)
+{
+  if(p->rqidx == 0 && (int)(p->vruntime - rq->minvruntime) > 0)
+    rq->minvruntime = p->vruntime;
+  if(p->rqidx != rq->n){
+    rq->heap[p->rqidx] = rq->heap[rq->n];
+    rq->heap[p->rqidx]->rqidx = p->rqidx;
+    heapfix(rq, p->rqidx);
+  }
+  rq->heap[rq->n] = 0;
 }
 
-// Grow current process's memory by n bytes.
-// Return 0 on success, -1 on failure.
-int
-growproc(int n)
+static struct proc*
+cfspick(struct runq *rq)
 {
-  uint sz;
-  struct proc *curproc = myproc();
+  return rq->n > 0 ? rq->heap[0] : 0;
+}
 
-  sz = curproc->sz;
-  if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
-      return -1;
-  } else if(n < 0){
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
-      return -1;
-  }
-  curproc->sz = sz;
-  switchuvm(curproc);
-  return 0;
+// A heap leaf: the process that would wait longest.
+static struct proc*
+cfssteal(struct runq *rq)
+{
+  return rq->n > 0 ? rq->heap[rq->n - 1] : 0;
 }
 
-// Create a new process copying p as the parent.
-// Sets up stack to return as if from system call.
-// Caller must set state of returned proc to RUNNABLE.
-int
-fork(void)
+// Give up the CPU once p has run a tick's worth of vruntime more
+// than the process with the least on its queue.  The queue is
+// read without its lock, so only a hint.
+static int
+cfstick(struct proc *p)
 {
-  int i, pid;
-  struct proc *np;
-  struct proc *curproc = myproc();
+  struct runq *rq = &runq[p->cpu];
+  struct proc *q;
 
-  // Allocate process.
-  if((np = allocproc()) == 0){
-    return -1;
-  }
+  if(p->priority < 1 || p->priority > NRQLEVEL)
+    panic("cfstick: priority");
+  p->vruntime += CFSUNIT / cfsweight[p->priority - 1];
+  if(rq->n == 0 || (q = rq->heap[0]) == 0)
+    return 0;
+  return (int)(p->vruntime - q->vruntime) >= CFSUNIT;
+}
 
-  // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
-    kfree(np->kstack);
-    np->kstack = 0;
-    np->state = UNUSED;
-    return -1;
+// Indexed by the SCHED_* numbers in sched.h.  FCFS never preempts.
+static struct schedclass classes[NSCHED] = {
+[SCHED_DEFAULT] { rrenqueue, fifodequeue, fifopick, fifosteal, rrtick, 0, 0 },
+[SCHED_FCFS]    { fcfsenqueue, fifodequeue, fifopick, fifosteal, 0, 0, 0 },
+[SCHED_SML]     { prioenqueue, fifodequeue, fifopick, fifosteal, smltick, 0, 0 },
+[SCHED_DML]     { prioenqueue, fifodequeue, fifopick, fifosteal, dmltick, dmlyield, dmlwakeup },
+[SCHED_CFS]     { cfsenqueue, cfsdequeue, cfspick, cfssteal, cfstick, 0, 0 },
+};
+
+// The active class.  SCHEDFLAG picks the one the kernel boots
+// with; setsched() switches at run time.
+#if defined(FCFS)
+static struct schedclass *schedclass = &classes[SCHED_FCFS];
+#elif defined(SML)
+static struct schedclass *schedclass = &classes[SCHED_SML];
+#elif defined(DML)
+static struct schedclass *schedclass = &classes[SCHED_DML];
+#elif defined(CFS)
+static struct schedclass *schedclass = &classes[SCHED_CFS];
+#else
+static struct schedclass *schedclass = &classes[SCHED_DEFAULT];
+#endif
+
+// Wake an idle CPU for the process just put on rq: the CPU that
+// owns rq or, if that one is busy and the process would wait
+// there, any idle CPU, to steal it.  An idle CPU sets c->idle
+// before its last look at the queues, so one of the two sides
+// always sees the other.
+static void
+runqkick(struct runq *rq)
+{
+  struct cpu *c = &cpus[rq - runq];
+
+  __sync_synchronize();
+  if(!c->idle){
+    if(rq->n == 1 && c->proc == 0)
+      return;
+    for(c = cpus; c < &cpus[ncpu] && !c->idle; c++)
+      ;
+    if(c == &cpus[ncpu])
+      return;
   }
-  np->sz = curproc->sz;
-  np->parent = curproc;
-  *np->tf = *curproc->tf;
+  if(c != mycpu())
+    lapicipi(c->apicid, T_IRQ0 + IRQ_WAKE);
+}
 
-  // Clear %eax so that fork returns 0 in the child.
-  np->tf->eax = 0;
-  np->priority = myproc()->priority;
+static void
+runqinit(void)
+{
+  int i;
 
-  for(i = 0; i < NOFILE; i++)
-    if(curproc->ofile[i])
-      np->ofile[i] = filedup(curproc->ofile[i]);
-  np->cwd = idup(curproc->cwd);
+  for(i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+}
 
-  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+// Add p to rq, whose lock is held.
+static void
+runqadd(struct runq *rq, struct proc *p)
+{
+  p->rq = rq;
+  rq->n++;
+  schedclass->enqueue(rq, p);
+}
 
-  pid = np->pid;
+// Take p off rq, whose lock is held.
+static void
+runqremove(struct runq *rq, struct proc *p)
+{
+  rq->n--;
+  schedclass->dequeue(rq, p);
+  p->rq = 0;
+}
 
-  acquire(&ptable.lock);
+// Put RUNNABLE process p on the run queue of the CPU it last
+// ran on, or on the shortest one if it has not run yet.
+// The ptable lock must be held.
+static void
+runqput(struct proc *p)
+{
+  struct runq *rq;
+  int i;
 
-  np->state = RUNNABLE;
+  if(p->rq)
+    panic("runqput");
+  if(p->cpu >= 0)
+    rq = &runq[p->cpu];
+  else {
+    rq = &runq[0];
+    for(i = 1; i < ncpu; i++)
+      if(runq[i].n < rq->n)
+        rq = &runq[i];
+  }
+
+  acquire(&rq->lock);
+  runqadd(rq, p);
+  release(&rq->lock);
+  runqkick(rq);
+}
 
-  release(&ptable.lock);
+// Take p off its run queue.
+// The ptable lock must be held.
+static void
+runqdel(struct proc *p)
+{
+  struct runq *rq;
 
-  return pid;
+  for(;;){
+    if((rq = p->rq) == 0)
+      panic("runqdel");
+    acquire(&rq->lock);
+    if(p->rq == rq)
+      break;
+    release(&rq->lock);   // stolen meanwhile
+  }
+  runqremove(rq, p);
+  release(&rq->lock);
 }
 
-// Exit the current process.  Does not return.
-// An exited process remains in the zombie state
-// until its parent calls wait() to find out it exited.
-void
-exit(void)
+// Take the next process to run off run queue rq, or return 0.
+// The ptable lock must be held.
+static struct proc*
+runqget(struct runq *rq)
 {
-  struct proc *curproc = myproc();
   struct proc *p;
 
-  if(curproc == initproc)
-    panic("init exiting");
+  acquire(&rq->lock);
+  if((p = schedclass->pick(rq)) != 0)
+    runqremove(rq, p);
+  release(&rq->lock);
+  return p;
+}
 
-  // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd]){
-      fileclose(curproc->ofile[fd]);
-      curproc->ofile[fd] = 0;
-    }
-  }
+// The queue an idle CPU with queue rq should steal from: the
+// busiest one, if it has a process that would otherwise wait
+// (more than one queued, or one queued behind a running process).
+// Returns 0 if there is none.  Reads the queues without their
+// locks, so only a hint.
+static struct runq*
+runqbusiest(struct runq *rq)
+{
+  struct runq *busiest = 0;
+  int i;
 
-  if(curproc->parent && curproc->parent->pid == 4){ 
-    // process run on sh
-    deleteSwapoutPageFiles();
-  }
+  for(i = 0; i < ncpu; i++)
+    if(&runq[i] != rq && runq[i].n > 0 && (busiest == 0 || runq[i].n > busiest->n))
+      busiest = &runq[i];
+  if(busiest == 0 || (busiest->n == 1 && cpus[busiest - runq].proc == 0))
+    return 0;
+  return busiest;
+}
 
-  begin_op();
-  iput(curproc->cwd);
-  end_op();
-  curproc->cwd = 0;
+// Move a process from the busiest queue to the idle CPU's queue
+// rq.  Returns 0 if there was none to move.
+// Called without ptable.lock.
+static int
+runqsteal(struct runq *rq)
+{
+  struct runq *busiest;
+  struct proc *p;
 
-  acquire(&ptable.lock);
+  if((busiest = runqbusiest(rq)) == 0)
+    return 0;
+  if(busiest < rq){
+    acquire(&busiest->lock);
+    acquire(&rq->lock);
+  } else {
+    acquire(&rq->lock);
+    acquire(&busiest->lock);
+  }
+  if((p = schedclass->steal(busiest)) != 0){
+    runqremove(busiest, p);
+    // Carry its lag behind the old queue over to the new one
+    // (a no-op but under CFS, where minvruntime stays 0).
+    p->vruntime = p->vruntime - busiest->minvruntime + rq->minvruntime;
+    runqadd(rq, p);
+  }
+  release(&busiest->lock);
+  release(&rq->lock);
+  return p != 0;
+}
 
-  // Parent might be sleeping in wait().
-  wakeup1(curproc->parent);
+// Switch to scheduling class id (one of the SCHED_* numbers),
+// requeueing every RUNNABLE process under it.  Virtual runtimes
+// start over.  Returns the previous class, or -1 if id is not a
+// class; id -1 just returns the current one.
+int
+setsched(int id)
+{
+  struct proc *p;
+  int i, old;
 
-  // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == curproc){
-      p->parent = initproc;
-      if(p->state == ZOMBIE)
-        wakeup1(initproc);
-    }
-  }
+  if(id == -1)
+    return schedclass - classes;
+  if(id < 0 || id >= NSCHED)
+    return -1;
 
-  // Jump into the scheduler, never to return.
-  curproc->state = ZOMBIE;
-  sched();
-  panic("zombie exit");
+  acquire(&ptable.lock);
+  old = schedclass - classes;
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->rq)
+      runqdel(p);
+    p->vruntime = 0;
+  }
+  // The queues are all empty now.  Switch classes with every
+  // queue lock held, so a steal in progress finishes under the
+  // old class.
+  for(i = 0; i < NCPU; i++)
+    acquire(&runq[i].lock);
+  for(i = 0; i < NCPU; i++)
+    runq[i].minvruntime = 0;
+  schedclass = &classes[id];
+  for(i = NCPU-1; i >= 0; i--)
+    release(&runq[i].lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->state == RUNNABLE && !p->evicting)
+      runqput(p);
+  release(&ptable.lock);
+  return old;
 }
 
-// Wait for a child process to exit and return its pid.
-// Return -1 if this process has no children.
+// Should the current process give up the CPU?
+// Called on every timer tick, without ptable.lock.
 int
-wait(void)
+schedtick(void)
 {
-  struct proc *p;
-  int havekids, pid;
-  struct proc *curproc = myproc();
-  
-  acquire(&ptable.lock);
-  for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
-        continue;
-      havekids = 1;
-      if(p->state == ZOMBIE){
-        // Found one.
-        pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
-        release(&ptable.lock);
-        return pid;
-      }
-    }
+  if(schedclass->tick == 0)
+    return 0;
+  return schedclass->tick(myproc());
+}
 
-    // No point waiting if we don't have any children.
-    if(!havekids || curproc->killed){
-      release(&ptable.lock);
-      return -1;
-    }
+// Ticks until the earliest sys_sleep() deadline, or 0 if nobody
+// is in sys_sleep().  A hint, read without ptable.lock.
+static uint
+nextwake(void)
+{
+  struct proc *p;
+  uint n = 0;
+  int d;
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
-    sleep(curproc, &ptable.lock);  //DOC: wait-sleep
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != SLEEPING || p->chan != &p->sleepuntil)
+      continue;
+    d = p->sleepuntil - ticks;
+    if(d < 1)
+      d = 1;
+    if(n == 0 || d < n)
+      n = d;
   }
+  return n;
 }
 
-int waitstats(int *retime, int *rutime, int *stime, int *ctime)
+// Restart c's periodic tick after tickless idle; cpu 0 also
+// credits the ticks it skipped.  c->tickless is cleared only
+// after that, as clocksync() waits on it.
+static void
+tickresume(struct cpu *c)
 {
-  struct proc *p; // child process
-  int havekids, pid;
-  struct proc *curproc = myproc(); // parent process
-  acquire(&ptable.lock);
-  for (;;)
-  {
-    // find zombie children.
-    havekids = 0;
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    {
-      if (p->parent != curproc)
-        continue;
-      havekids = 1;
-      if (p->state == ZOMBIE)
-      { // child is zombie
-        // reset child and remove it from ptable
-        *retime = p->retime;
-        *rutime = p->rutime;
-        *stime = p->stime;
-        *ctime = p->ctime;
-        pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->state = UNUSED;
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->ctime = 0;
-        p->retime = 0;
-        p->rutime = 0;
-        p->stime = 0;
-        p->priority = 0;
-        release(&ptable.lock);
-        return pid;
-      }
-    }
-    // Failed to find children.
-    if (!havekids || curproc->killed)
-    {
-      release(&ptable.lock);
-      return -1;
-    }
-    // Wait for children to exit.
-    sleep(curproc, &ptable.lock);
-  }
+  uint n;
+
+  if(!c->tickless)
+    return;
+  n = lapictickresume();
+  if(c == &cpus[0])
+    tickadvance(n);
+  c->tickless = 0;
 }
 
-#ifdef SML
-// Find the first process in ptable which is RUNNABLE and of highest priority
-struct proc *findmaxprio(int *i1, int *i2, int *i3, uint *priority)
+// Halt CPU c, whose run queue rq looked empty, until an interrupt
+// arrives; runqput() sends an IPI to an idle CPU it has work for.
+// Idle CPUs stop their periodic tick.  Cpu 0 keeps time, so it
+// only does so while no other CPU is running a process, and then
+// sets its timer for the next sys_sleep() deadline and catches up
+// on the ticks it skipped when it wakes.  A CPU about to run a
+// process wakes a tickless cpu 0 first (see scheduler), so the
+// clock is never stale while anyone can read it.
+static void
+idle(struct cpu *c, struct runq *rq)
 {
-  int i = 0;
-  struct proc *proc_find;
-again:
-  i = 0;
-  while (i != NPROC)
-  {
-    if (*priority == 1)
-    {
-      proc_find = &ptable.proc[(*i1 + i) % NPROC];
-      if (proc_find->state == RUNNABLE && proc_find->priority == *priority)
-      {
-        *i1 = *i1 + (1 + i);
-        *i1 = (*i1) % NPROC;
-        return proc_find; // found RUNNABLE with prio 1
-      }
-    }
-    else if (*priority == 2)
-    {
-      proc_find = &ptable.proc[(*i2 + i) % NPROC];
-      if (proc_find->state == RUNNABLE && proc_find->priority == *priority)
-      {
-        *i2 = *i2 + (1 + i);
-        *i2 = (*i2) % NPROC;
-        return proc_find; // found RUNNABLE with prio 2
-      }
-    }
-    else
-    {
-      proc_find = &ptable.proc[(*i3 + i) % NPROC];
-      if (proc_find->state == RUNNABLE && proc_find->priority == *priority)
-      {
-        *i3 = *i3 + (1 + i);
-        *i3 = (*i3) % NPROC;
-        return proc_find; // found RUNNABLE with prio 3
-      }
-    }
-    i++;
-  }
-  if (*priority == 1)
-  { // No RUNNABLE found
-    *priority = 3;
-  }
-  else
-  {
-    *priority -= 1; // find RUNNABLE with lower prio
-    goto again;
-  }
-  return 0;
+  int i;
+
+  cli();
+  c->idle = 1;
+  __sync_synchronize();
+  if(rq->n == 0 && runqbusiest(rq) == 0){
+    c->tickless = 1;
+    __sync_synchronize();
+    if(c == &cpus[0])
+      for(i = 1; i < ncpu; i++)
+        if(cpus[i].proc)
+          c->tickless = 0;
+    if(c->tickless)
+      lapictickless(c == &cpus[0] ? nextwake() : 0);
+    stihlt();
+    cli();
+  }
+  tickresume(c);
+  c->idle = 0;
 }
-#endif
 
-#ifdef DML
-// Find the first process in ptable which is RUNNABLE and of highest priority
-struct proc *findmaxprio(int *i1, int *i2, int *i3, uint *priority)
+// Called at the start of an interrupt that found this CPU idle,
+// before its handler can wake anyone.  If cpu 0 is tickless, the
+// clock is behind and would put stale stamps on the processes
+// woken (see setstate), so cpu 0 catches up first: at once if this
+// is cpu 0, otherwise when this CPU's IPI wakes it.
+void
+clocksync(void)
 {
-  int i = 0;
-  struct proc *proc_find;
-again:
-  i = 0;
-  while (i != NPROC)
-  {
-    if (*priority == 1)
-    {
-      proc_find = &ptable.proc[(*i1 + i) % NPROC];
-      if (proc_find->state == RUNNABLE && proc_find->priority == *priority)
-      {
-        *i1 = *i1 + (1 + i);
-        *i1 = (*i1) % NPROC;
-        return proc_find; // found RUNNABLE with prio 1
-      }
-    }
-    else if (*priority == 2)
-    {
-      proc_find = &ptable.proc[(*i2 + i) % NPROC];
-      if (proc_find->state == RUNNABLE && proc_find->priority == *priority)
-      {
-        *i2 = *i2 + (1 + i);
-        *i2 = (*i2) % NPROC;
-        return proc_find; // found RUNNABLE with prio 2
-      }
-    }
-    else
-    {
-      proc_find = &ptable.proc[(*i3 + i) % NPROC];
-      if (proc_find->state == RUNNABLE && proc_find->priority == *priority)
-      {
-        *i3 = *i3 + (1 + i);
-        *i3 = (*i3) % NPROC;
-        return proc_find; // found RUNNABLE with prio 3
-      }
-    }
-    i++;
-  }
-  if (*priority == 1)
-  { // No RUNNABLE found
-    *priority = 3;
-  }
-  else
-  {
-    *priority -= 1; // find RUNNABLE with lower prio
-    goto again;
+  struct cpu *c = mycpu();
+
+  if(!c->idle)
+    return;
+  if(c == &cpus[0])
+    tickresume(c);
+  else if(cpus[0].tickless){
+    lapicipi(cpus[0].apicid, T_IRQ0 + IRQ_WAKE);
+    while(cpus[0].tickless)
+      ;
   }
-  return 0;
 }
-#endif
 
-//PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
@@ -1875,131 +1575,61 @@ void scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  struct runq *rq = &runq[c - cpus];
   c->proc = 0;
-  int i1 = 0;
-  int i2 = 0;
-  int i3 = 0;
-
-  i1++;
-  i1--;
-  i3++;
-  i3--;
-  i2++;
-  i2--;
-
-  /*int x = i1;
-  i1 = x;
-  x = i2;
-  i2 = x;
-  x = i3;
-  i3 = x;*/
+
   while (1)
   {
     // Enable interrupts on this processor.
     sti();
 
-    acquire(&ptable.lock);
-#ifdef DEFAULT
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    {
-      if (p->state != RUNNABLE)
-        continue;
-
-      // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
-      // before jumping back to us.
-      c->proc = p;
-      switchuvm(p);
-      p->state = RUNNING;
-
-      // cprintf("PID: %d\tTick before exec: %d\n", p->pid, ticks);
-
-      p->ticks_elapsed = 0;
-      swtch(&(c->scheduler), p->context);
-      switchkvm();
-
-      // cprintf("       \tTick after exec : %d\n", ticks);
-
-      // Process is done running for now.
-      // It should have changed its p->state before coming back.
-      c->proc = 0;
-    }
-#else
-
-#ifdef FCFS
-    struct proc *min_prio_proc = NULL;
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    {
-      if (p->state == RUNNABLE)
-      {
-        if (min_prio_proc != NULL)
-        {
-          if (p->ctime < min_prio_proc->ctime)
-            min_prio_proc = p;
-        }
-        else
-          min_prio_proc = p;
-      }
-    }
-    if (min_prio_proc != NULL)
-    {
-      p = min_prio_proc; // process with smallest creation time
-      c->proc = p;
-      switchuvm(p);
-      p->state = RUNNING;
-
-      // cprintf("PID: %d\tTick before exec: %d\n", p->pid, ticks);
-      swtch(&(c->scheduler), p->context);
-      switchkvm();
-      // cprintf("       \tTick after exec : %d\n", ticks);
-
-      // proc completes it's execution and has changed it's state already
-      c->proc = 0;
-    }
-#else
-
-#ifdef SML
-    uint priority = 3;
-    p = findmaxprio(&i1, &i2, &i3, &priority);
-    if (p == 0)
+    // Nothing to run or steal: halt rather than spin on
+    // the queue locks.
+    if (rq->n == 0 && runqbusiest(rq) == 0)
     {
-      release(&ptable.lock);
+      idle(c, rq);
       continue;
     }
-    c->proc = p;
-    switchuvm(p);
-    p->state = RUNNING;
-
-    //  cprintf("PID: %d\tTick before exec: %d\n", p->pid, ticks);
-    swtch(&(c->scheduler), p->context);
-    switchkvm();
-    // cprintf("       \tTick after exec : %d\n", ticks);
-
-    c->proc = 0;
-#else
+    // Stealing only moves a process between queues, so it does
+    // not need ptable.lock.
+    if (rq->n == 0 && !runqsteal(rq))
+      continue;
 
-#ifdef DML
-    uint priority = 3;
-    p = findmaxprio(&i1, &i2, &i3, &priority);
+    acquire(&ptable.lock);
+    // A directed yield or a group mate's wakeup may have named
+    // the process to run next (see yieldto and groupplace).
+    p = c->next;
+    c->next = 0;
+    if (p && p->rq == rq)
+      runqdel(p);
+    else
+      p = runqget(rq);
     if (p == 0)
     {
       release(&ptable.lock);
       continue;
     }
+    p->cpu = rq - runq;
+
+    // Switch to chosen process.  It is the process's job
+    // to release ptable.lock and then reacquire it
+    // before jumping back to us.
     c->proc = p;
+    __sync_synchronize();
+    if (cpus[0].tickless)
+      lapicipi(cpus[0].apicid, T_IRQ0 + IRQ_WAKE);
     switchuvm(p);
-    p->state = RUNNING;
+    setstate(p, RUNNING);
     p->ticks_elapsed = 0;
-    //  cprintf("PID: %d\tTick before exec: %d\n", p->pid, ticks);
+
+    // cprintf("PID: %d\tTick before exec: %d\n", p->pid, ticks);
     swtch(&(c->scheduler), p->context);
     switchkvm();
     // cprintf("       \tTick after exec : %d\n", ticks);
 
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
     c->proc = 0;
-#endif
-#endif
-#endif
-#endif
     release(&ptable.lock);
   }
 }
@@ -2034,11 +1664,84 @@ void
 yield(void)
 {
   acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  if(schedclass->yield)
+    schedclass->yield(myproc());
+  setstate(myproc(), RUNNABLE);
+  runqput(myproc());
   sched();
   release(&ptable.lock);
 }
 
+// Give up the CPU to process pid, if it is RUNNABLE: it moves to
+// this CPU's run queue and runs next.  Returns -1 if there is no
+// such process waiting to run.
+int
+yieldto(int pid)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->pid == pid && p->state == RUNNABLE && p->rq)
+      break;
+  if(p == &ptable.proc[NPROC] || p == myproc()){
+    release(&ptable.lock);
+    return -1;
+  }
+  runqdel(p);
+  p->cpu = cpuid();
+  runqput(p);
+  mycpu()->next = p;
+  release(&ptable.lock);
+  yield();
+  return 0;
+}
+
+// Processes in a cooperating group pass work to each other, over
+// a pipe say, so they should run at the same time on different
+// CPUs rather than take turns on one.  When group member p becomes
+// RUNNABLE, send it to an idle CPU if there is one; otherwise, if
+// a group mate woke it, queue it on the mate's CPU to run as soon
+// as the mate gives up the CPU, instead of after a whole round.
+// The ptable lock must be held.
+static void
+groupplace(struct proc *p)
+{
+  struct proc *me = myproc();
+  struct cpu *c;
+
+  if(p->group == 0 || (p->cpu >= 0 && cpus[p->cpu].idle))
+    return;
+  for(c = cpus; c < &cpus[ncpu]; c++){
+    if(c->idle){
+      p->cpu = c - cpus;
+      return;
+    }
+  }
+  if(me && me != p && me->group == p->group){
+    p->cpu = cpuid();
+    mycpu()->next = p;
+  }
+}
+
+// Put the calling process in cooperating group g (0 for none); its
+// children inherit it.  Returns the previous group; g = -1 just
+// returns the current one.
+int
+setgroup(int g)
+{
+  int old;
+
+  if(g < -1)
+    return -1;
+  acquire(&ptable.lock);
+  old = myproc()->group;
+  if(g != -1)
+    myproc()->group = g;
+  release(&ptable.lock);
+  return old;
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch here.  "Return" to user space.
 void
@@ -2055,6 +1758,7 @@ forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    swapinit(ROOTDEV);
     create_kernel_process("swapoutprocess",swapoutprocess);
     create_kernel_process("swapinprocess",swapinprocess);
   }
@@ -2087,7 +1791,7 @@ sleep(void *chan, struct spinlock *lk)
   }
   // Go to sleep.
   p->chan = chan;
-  p->state = SLEEPING;
+  setstate(p, SLEEPING);
 
   sched();
 
@@ -2101,6 +1805,24 @@ sleep(void *chan, struct spinlock *lk)
   }
 }
 
+// Make sleeping process p RUNNABLE.  If evictPage() is writing
+// out one of its pages, just note the wakeup; evictPage() delivers
+// it when the write is done.
+// The ptable lock must be held.
+static void
+wakeproc(struct proc *p)
+{
+  if(p->evicting){
+    p->wakepending = 1;
+    return;
+  }
+  setstate(p, RUNNABLE);
+  if(schedclass->wakeup)
+    schedclass->wakeup(p);
+  groupplace(p);
+  runqput(p);
+}
+
 //PAGEBREAK!
 // Wake up all processes sleeping on chan (chan is a channel).
 // The ptable lock must be held.
@@ -2111,12 +1833,7 @@ wakeup1(void *chan)
 
   for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
     if (p->state == SLEEPING && p->chan == chan)
-    {
-      p->state = RUNNABLE;
-#ifdef DML
-      p->priority = 3; // Set priority to 3 (Max value) when process returns from I/O
-#endif
-    }
+      wakeproc(p);
 }
 
 // Wake up all processes sleeping on chan.
@@ -2128,6 +1845,22 @@ wakeup(void *chan)
   release(&ptable.lock);
 }
 
+// Wake p if it is sleeping on chan, without the scan of the
+// whole process table that wakeup() does.  Returns 1 if it did.
+int
+wakeupproc(struct proc *p, void *chan)
+{
+  int woken = 0;
+
+  acquire(&ptable.lock);
+  if(p->state == SLEEPING && p->chan == chan){
+    wakeproc(p);
+    woken = 1;
+  }
+  release(&ptable.lock);
+  return woken;
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
@@ -2141,8 +1874,12 @@ kill(int pid)
     if(p->pid == pid){
       p->killed = 1;
       // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
+      if(p->state == SLEEPING && p->evicting)
+        p->wakepending = 1;
+      else if(p->state == SLEEPING){
+        setstate(p, RUNNABLE);
+        runqput(p);
+      }
       release(&ptable.lock);
       return 0;
     }
@@ -2188,28 +1925,35 @@ procdump(void)
   }
 }
 
-// triggered on every clock tick to update the statistics for each process
-void updatestats()
+// Time accounting.  Rather than a sweep of the process table on
+// every tick, a process is charged for the time it spent in a
+// state when it leaves it, from the tick it entered it (p->stamp).
+// Every change between SLEEPING, RUNNABLE, RUNNING and ZOMBIE goes
+// through here, with ptable.lock held.
+static void
+setstate(struct proc *p, enum procstate state)
 {
-  struct proc *p;
-  acquire(&ptable.lock);
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-  {
-    switch (p->state)
-    {
-    case SLEEPING:
-      p->stime++;
-      break;
-    case RUNNABLE:
-      p->retime++;
-      break;
-    case RUNNING:
-      p->rutime++;
-      break;
-    default:;
-    }
-  }
-  release(&ptable.lock);
+  uint now = ticks;
+  uint64 ns = nsclock();
+
+  switch(p->state){
+  case SLEEPING:
+    p->stime += now - p->stamp;
+    p->nsstime += ns - p->nsstamp;
+    break;
+  case RUNNABLE:
+    p->retime += now - p->stamp;
+    p->nsretime += ns - p->nsstamp;
+    break;
+  case RUNNING:
+    p->rutime += now - p->stamp;
+    p->nsrutime += ns - p->nsstamp;
+    break;
+  default:;
+  }
+  p->state = state;
+  p->stamp = now;
+  p->nsstamp = ns;
 }
 
 int set_prio(int priority)
@@ -2222,20 +1966,26 @@ int set_prio(int priority)
   return 0;
 }
 
-void dec_prio(void)
+// Raise every process to priority 3, so DML's CPU-bound processes
+// demoted to the bottom level are not starved by a stream of
+// interactive ones.  Called every BOOSTTICKS ticks.
+void boost_prio(void)
 {
-  acquire(&ptable.lock);
-  myproc()->priority = myproc()->priority == 1 ? 1 : myproc()->priority - 1;
-  release(&ptable.lock);
-}
+  struct proc *p;
 
-int inc_ticks_elapsed()
-{
-  int res;
+  if(schedclass != &classes[SCHED_DML])
+    return;
   acquire(&ptable.lock);
-  res = ++myproc()->ticks_elapsed;
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state == UNUSED || p->priority == 3)
+      continue;
+    p->priority = 3;
+    if(p->rq){
+      runqdel(p);
+      runqput(p);
+    }
+  }
   release(&ptable.lock);
-  return res;
 }
 
 // This function create a kernel process and add it to the processes queue.
@@ -2260,9 +2010,7 @@ void create_kernel_process(const char *name, void (*entrypoint)())
     return;
   }
   else{
-    ptable.proc[i].state = EMBRYO;
-    ptable.proc[i].pid = nextpid;
-    nextpid = nextpid + 1;
+    procfresh(&ptable.proc[i]);
 
     release(&ptable.lock);
 
@@ -2299,7 +2047,8 @@ void create_kernel_process(const char *name, void (*entrypoint)())
     safestrcpy(ptable.proc[i].name, name, sizeof(ptable.proc[i].name));
 
     acquire(&ptable.lock);
-    ptable.proc[i].state = RUNNABLE;
+    setstate(&ptable.proc[i], RUNNABLE);
+    runqput(&ptable.proc[i]);
     release(&ptable.lock);
     return;
   }
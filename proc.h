@@ -8,6 +8,12 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  char *kmag[KMAG];            // Free pages cached for kalloc()
+  int nkmag;                   // Number of pages in kmag
+  volatile int idle;           // Halted in scheduler() for want of work
+  volatile int tickless;       // Periodic tick stopped while idle
+  uint tscmult;                // TSC cycles to ns, times 2^24 (clock.c)
+  struct proc *next;           // Run next, if still on this CPU's queue
   
   // Cpu-local storage variables; see below
   struct cpu *cpu;
@@ -46,6 +52,14 @@ struct context {
   uint eip;
 };
 
+// A program segment that exec() left in the executable,
+// to be read in a page at a time as it is touched.
+struct execseg {
+  uint va;                     // First address (page aligned)
+  uint off;                    // File offset of the first byte
+  uint filesz;                 // Bytes backed by the file; the rest is zero
+};
+
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -63,9 +77,45 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct inode *exe;           // Executable, for pages not yet loaded
+  struct execseg seg[NEXECSEG]; // Its segments; filesz 0 if unused
   
   int satisfied;               // If zero, page request not satisifed
   uint trapva;                 // VA at which pagefault occurred
+  int evicting;                // evictPage() is writing out a page of p
+  int wakepending;             // Woken meanwhile; wake when it is done
+  int rawindow;                // Pages to read ahead on the next swap-in
+  uint rastart;                // First page of the last read-ahead
+  uint ramask;                 // Pages after rastart it brought in
+  uint nfault;                 // Faults on swapped-out pages
+  uint nswapin;                // Pages swapped in, read-ahead included
+  uint nswapout;               // Pages written to swap
+  uint ncleandrop;             // Pages evicted without a write
+  uint swapwait;               // Ticks waiting for a free page
+
+  int priority;                // Scheduling priority (1 = low, 3 = high)
+  int ctime;                   // Tick at which the process was created
+  int retime;                  // Ticks spent RUNNABLE
+  int rutime;                  // Ticks spent RUNNING
+  int stime;                   // Ticks spent SLEEPING
+  uint stamp;                  // Tick p entered its current state
+  uint64 nsstamp;              // nsclock() when it did
+  uint64 nsretime;             // retime, rutime and stime to the
+  uint64 nsrutime;             //   nanosecond
+  uint64 nsstime;
+  int ticks_elapsed;           // Ticks run in the current quantum
+  uint sleepuntil;             // Tick a sys_sleep() is due to end
+  struct proc **twlist;        // Timer wheel slot p is on, if any
+  struct proc *twnext;         // Next and previous in that slot
+  struct proc *twprev;
+  struct runq *rq;             // Run queue p is on, if RUNNABLE
+  struct proc *rqnext;         // Next and previous on that queue
+  struct proc *rqprev;
+  int rqlevel;                 // Priority level list p is on
+  int cpu;                     // CPU p last ran on (affinity), or -1
+  int rqidx;                   // CFS: p's slot in the run queue heap
+  uint vruntime;               // CFS: weighted running time
+  int group;                   // Cooperating group (setgroup), or 0
 };
 
 // extern void wakeup1(void *chan);
@@ -75,5 +125,3 @@ struct proc {
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
-
-void updatestats();
\ No newline at end of file
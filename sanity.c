@@ -1,5 +1,7 @@
 #include "types.h"
 #include "user.h"
+#include "sched.h"
+#include "clock.h"
 #include <stdbool.h>
 
 // 1 second == 100 ticks //
@@ -9,22 +11,63 @@ int fibo(int n) {
 	return fibo(n-1) + fibo(n-2);
 }
 
-int
-main(int argc, char *argv[])
-{
-	if (argc != 2){
-		printf(1, "Usage: sanity <n>\n");
-		exit();
- 	}
+#define SHARE_TICKS 500
+
+int usec(struct timespec *ts) {
+	return ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
+
+// Runs 3n CPU-bound children side by side for SHARE_TICKS ticks,
+// a third at each priority, and reports the CPU time each priority
+// got.  Under CFS the running times follow the 1:2:4 weights of
+// priorities 1, 2 and 3.
+void share(int n) {
+	int pids[64], total[3];
+	int pid, retime, rutime, stime, ctime;
+	int start = uptime();
+
+	memset(total, 0, sizeof(total));
+	for (int i = 0; i < 3 * n; i++) {
+		pid = fork();
+		if (pid == 0) {
+			set_prio(i % 3 + 1);
+			while (uptime() < start + SHARE_TICKS)
+				fibo(10);
+			exit();
+		}
+		pids[i] = pid;
+	}
+
+	for (int i = 0; i < 3 * n; i++) {
+		pid = wait2(&retime, &rutime, &stime, &ctime);
+		for (int k = 0; k < 3 * n; k++)
+			if (pids[k] == pid)
+				total[k % 3] += rutime;
+	}
+
+	for (int i = 0; i < 3; i++)
+		printf(1, "Priority %d: average running time %d, ratio to priority 1: %d.%d\n", i + 1, total[i] / n,
+		       total[0] ? total[i] / total[0] : 0, total[0] ? total[i] * 10 / total[0] % 10 : 0);
+}
 
-	int n = atoi(argv[1]), j = 0;
+// Runs 3n children, n each of CPU-bound, short-task CPU-bound and
+// I/O-bound, and reports their ready, running and sleeping times.
+void bench(int n) {
+	int j = 0, first = 0;
 	int retime, rutime, stime;
 	int ctime;
 
 	int avgRetime[3], avgRutime[3], avgStime[3];
+	// The same in microseconds, as ticks are too coarse for the short tasks.
+	int usRetime[3], usRutime[3], usStime[3];
+	struct proctimes pt;
+	char *kinds[3] = { "CPU bound", "CPU-S bound", "I/O bound" };
 	memset(avgRetime, 0, sizeof(avgRetime));
 	memset(avgRutime, 0, sizeof(avgRutime));
 	memset(avgStime, 0, sizeof(avgStime));
+	memset(usRetime, 0, sizeof(usRetime));
+	memset(usRutime, 0, sizeof(usRutime));
+	memset(usStime, 0, sizeof(usStime));
 
 	int pid;
 	for (int i = 0; i < 3 * n; i++) {
@@ -32,8 +75,6 @@ main(int argc, char *argv[])
 		pid = fork();
 		if (pid == 0) {
             // child
-            // parent process has pid 3
-			j = (getpid() - 4) % 3; // ensures independence from the first son's pid when gathering the results in the second part of the program
 			switch(j) {
 				case 0:
 				// 1000000
@@ -64,11 +105,18 @@ main(int argc, char *argv[])
 		}
 		
 		// parent continues to spawn the next child
+		if (i == 0)
+			first = pid;
 	}
 
 	for (int i = 0; i < 3 * n; i++) {
-		pid = wait2(&retime, &rutime, &stime, &ctime);
-		int res = (pid - 4) % 3; // correlates to j in the dispatching loop
+		pid = wait3(&retime, &rutime, &stime, &ctime, &pt);
+		int res = (pid - first) % 3; // correlates to j in the dispatching loop
+		if (res >= 0 && res < 3) {
+			usRetime[res] += usec(&pt.retime);
+			usRutime[res] += usec(&pt.rutime);
+			usStime[res] += usec(&pt.stime);
+		}
 		switch(res) {
 			case 0: 
                 // CPU bound processes
@@ -98,10 +146,57 @@ main(int argc, char *argv[])
 		avgRetime[i] /= n;
 		avgRutime[i] /= n;
 		avgStime[i] /= n;
+		usRetime[i] /= n;
+		usRutime[i] /= n;
+		usStime[i] /= n;
 	}
 
 	printf(1, "\n\nCPU bound:\nAverage ready time: %d\nAverage running time: %d\nAverage sleeping time: %d\nAverage turnaround time: %d\n\n\n", avgRetime[0], avgRutime[0], avgStime[0], avgRetime[0] + avgRutime[0] + avgStime[0]);
 	printf(1, "CPU-S bound:\nAverage ready time: %d\nAverage running time: %d\nAverage sleeping time: %d\nAverage turnaround time: %d\n\n\n", avgRetime[1], avgRutime[1], avgStime[1], avgRetime[1] + avgRutime[1] + avgStime[1]);
 	printf(1, "I/O bound:\nAverage ready time: %d\nAverage running time: %d\nAverage sleeping time: %d\nAverage turnaround time: %d\n\n\n", avgRetime[2], avgRutime[2], avgStime[2], avgRetime[2] + avgRutime[2] + avgStime[2]);
+	for (int i = 0; i < 3; i++)
+		printf(1, "%s: average ready %d us, running %d us, sleeping %d us\n", kinds[i], usRetime[i], usRutime[i], usStime[i]);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static char *policies[] = SCHEDNAMES;
+	int all = 0, old;
+
+	if (argc > 2 && strcmp(argv[argc - 1], "all") == 0) {
+		all = 1;
+		argc--;
+	}
+	if ((argc != 2 && argc != 3) || (argc == 3 && strcmp(argv[2], "share") != 0)){
+		printf(1, "Usage: sanity <n> [share] [all]\n");
+		exit();
+ 	}
+
+	int n = atoi(argv[1]);
+	if (argc == 3 && (n < 1 || n > 20)){
+		printf(1, "sanity: share needs n between 1 and 20\n");
+		exit();
+	}
+	if (!all) {
+		if (argc == 3)
+			share(n);
+		else
+			bench(n);
+		exit();
+	}
+
+	// Run the sweep under every scheduling class in turn.
+	old = setsched(-1);
+	for (int c = 0; c < NSCHED; c++) {
+		setsched(c);
+		printf(1, "Scheduling policy: %s\n\n", policies[c]);
+		if (argc == 3)
+			share(n);
+		else
+			bench(n);
+		printf(1, "\n");
+	}
+	setsched(old);
 	exit();
 }
\ No newline at end of file
@@ -0,0 +1,10 @@
+// Scheduling classes, for setsched().
+#define SCHED_DEFAULT 0   // Round robin, QUANTA ticks each
+#define SCHED_FCFS    1   // First come first served, never preempted
+#define SCHED_SML     2   // Static priorities (set_prio), a tick each
+#define SCHED_DML     3   // Multilevel feedback queue
+#define SCHED_CFS     4   // Weighted fair share by virtual runtime
+#define NSCHED        5   // Number of classes
+
+// Their names, indexed by the numbers above.
+#define SCHEDNAMES { "default", "FCFS", "SML", "DML", "CFS" }
@@ -4,6 +4,7 @@
 #include "user.h"
 #include "fcntl.h"
 #include "console.h"
+#include "sched.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -121,6 +122,10 @@ runcmd(struct cmd *cmd)
     pcmd = (struct pipecmd*)cmd;
     if(pipe(p) < 0)
       panic("pipe");
+    // Run the whole pipeline as one cooperating group, so its
+    // stages run side by side (see setgroup).
+    if(setgroup(-1) == 0)
+      setgroup(getpid());
     if(fork1() == 0){
       close(1);
       dup(p[1]);
@@ -164,22 +169,9 @@ getcmd(char *buf, int nbuf)
 int
 main(void)
 {
-  printf(1, "Selected scheduling policy: ");
-  #ifdef DEFAULT
-    printf(1, "default\n");
-  #else
-  #ifdef FCFS
-    printf(1, "FCFS\n");
-  #else
-  #ifdef SML
-    printf(1, "SML\n");
-  #else
-  #ifdef DML
-    printf(1, "DML\n");
-  #endif
-  #endif
-  #endif
-  #endif
+  static char *policies[] = SCHEDNAMES;
+
+  printf(1, "Selected scheduling policy: %s\n", policies[setsched(-1)]);
   
   static char buf[100];
   int fd;
@@ -0,0 +1,178 @@
+// Swap area.
+//
+// mkfs reserves a raw region of the disk, after the file system
+// blocks, for pages evicted from memory (see struct superblock).
+// The region is divided into page-sized slots and an in-memory
+// table counts the references to each slot: one per swapped-out
+// PTE (processes sharing a page copy-on-write share its slot too)
+// plus one if it is the swap cache copy of a resident page.  A page moves to or from
+// its slot with a single multi-sector disk request, so swapping
+// never touches the log, inodes or directories.
+//
+// A swapped-out PTE holds its slot number in place of the physical
+// page address (see PTE_SWAP in mmu.h).
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+
+#define BPS    (PGSIZE/BSIZE)   // disk blocks per swap slot
+#define NSLOT  (SWAPSIZE/BPS)   // most slots the bitmap can track
+
+struct {
+  struct spinlock lock;
+  uint dev;
+  uint start;         // first block of the swap area
+  uint nslot;         // number of usable slots
+  uint nfree;         // number of free slots
+  uint next;          // slot where the next search starts
+  uchar ref[NSLOT];   // references to each slot, 0 if free
+
+  // Request buffers.  swaprw() moves one page with buf[0];
+  // swapreadv() reads up to SWAPRAMAX pages in one batch.  Users
+  // lock the buffers in index order, so they never deadlock.
+  struct buf buf[SWAPRAMAX];
+} swap;
+
+void
+swapinit(int dev)
+{
+  struct superblock sb;
+
+  int i;
+
+  initlock(&swap.lock, "swap");
+  for(i = 0; i < SWAPRAMAX; i++)
+    initsleeplock(&swap.buf[i].lock, "swapbuf");
+  readsb(dev, &sb);
+  swap.dev = dev;
+  swap.start = sb.swapstart;
+  swap.nslot = sb.nswap / BPS;
+  if(swap.nslot > NSLOT)
+    swap.nslot = NSLOT;
+  swap.nfree = swap.nslot;
+  cprintf("swap: %d slots starting at block %d\n", swap.nslot, swap.start);
+}
+
+// Allocate a swap slot.
+// Returns the slot number, or -1 if the swap area is full.
+int
+swapalloc(void)
+{
+  uint i, s;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    s = (swap.next + i) % swap.nslot;
+    if(swap.ref[s] == 0){
+      swap.ref[s] = 1;
+      swap.next = s + 1;
+      swap.nfree--;
+      release(&swap.lock);
+      return s;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Drop a reference to a swap slot, freeing it with the last one.
+void
+swapfree(uint slot)
+{
+  acquire(&swap.lock);
+  if(slot >= swap.nslot || swap.ref[slot] == 0)
+    panic("swapfree");
+  if(--swap.ref[slot] == 0)
+    swap.nfree++;
+  release(&swap.lock);
+}
+
+// Add a reference to an allocated swap slot.
+void
+swapdup(uint slot)
+{
+  acquire(&swap.lock);
+  if(slot >= swap.nslot || swap.ref[slot] == 0 || swap.ref[slot] == 255)
+    panic("swapdup");
+  swap.ref[slot]++;
+  release(&swap.lock);
+}
+
+// Number of references to a swap slot.
+int
+swapref(uint slot)
+{
+  int n;
+
+  acquire(&swap.lock);
+  n = swap.ref[slot];
+  release(&swap.lock);
+  return n;
+}
+
+// Move one page between memory and a swap slot.
+static void
+swaprw(uint slot, char *page, int write)
+{
+  struct buf *b = &swap.buf[0];
+
+  if(slot >= swap.nslot)
+    panic("swaprw");
+  acquiresleep(&b->lock);
+  b->dev = swap.dev;
+  b->blockno = swap.start + slot*BPS;
+  b->page = (uchar*)page;
+  b->flags = write ? B_DIRTY : 0;
+  iderw(b);
+  b->page = 0;
+  releasesleep(&b->lock);
+}
+
+// Read the page held in slot into page.
+void
+swapread(uint slot, char *page)
+{
+  swaprw(slot, page, 0);
+}
+
+// Write page to slot.
+void
+swapwrite(uint slot, char *page)
+{
+  swaprw(slot, page, 1);
+}
+
+// Read the pages held in slot[0..n-1] into page[0..n-1]
+// with a single batch of disk requests.
+void
+swapreadv(uint *slot, char **page, int n)
+{
+  struct buf *bv[SWAPRAMAX];
+  struct buf *b;
+  int i;
+
+  if(n < 0 || n > SWAPRAMAX)
+    panic("swapreadv");
+  for(i = 0; i < n; i++){
+    if(slot[i] >= swap.nslot)
+      panic("swapreadv slot");
+    b = bv[i] = &swap.buf[i];
+    acquiresleep(&b->lock);
+    b->dev = swap.dev;
+    b->blockno = swap.start + slot[i]*BPS;
+    b->page = (uchar*)page[i];
+    b->flags = 0;
+  }
+  if(n > 0)
+    iderwv(bv, n);
+  for(i = 0; i < n; i++){
+    bv[i]->page = 0;
+    releasesleep(&bv[i]->lock);
+  }
+}
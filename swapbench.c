@@ -0,0 +1,78 @@
+#include "types.h"
+#include "user.h"
+#include "swapstat.h"
+
+#define PAGE_SIZE 4096
+#define PASSES 4
+
+// Sizes of the working set to sweep, in pages.  Physical memory
+// holds about 700 user pages and the swap area 1024.
+int sizes[] = { 64, 128, 256, 512, 768, 1024 };
+
+// Touches npages pages passes times in order, checking on each
+// pass what the previous one wrote, then reports its swap counts.
+void Child_Function(int npages, int passes) {
+    struct swapstat st;
+    char *buf;
+    int start, ticks, touches;
+
+    buf = sbrk(npages * PAGE_SIZE);
+    if (buf == (char *)-1) {
+        printf(1, "swapbench: sbrk %d pages failed\n", npages);
+        exit();
+    }
+
+    start = uptime();
+    for (int pass = 0; pass < passes; pass++) {
+        for (int i = 0; i < npages; i++) {
+            if (pass > 0 && buf[i * PAGE_SIZE] != (char)(i + pass - 1)) {
+                printf(1, "swapbench: page %d corrupted on pass %d\n", i, pass);
+                exit();
+            }
+            buf[i * PAGE_SIZE] = (char)(i + pass);
+        }
+    }
+    ticks = uptime() - start;
+
+    getswapstats(getpid(), &st);
+    touches = npages * passes;
+    printf(1, "%d\t%d\t%d\t%d\t%d\t%d\t%d\t", npages, st.faults, st.faults * 1000 / touches,
+           st.swapins, st.swapouts, st.cleandrops, st.waitticks);
+    if (ticks > 0)
+        printf(1, "%d\t%d\n", ticks, touches / ticks);
+    else
+        printf(1, "%d\t-\n", ticks);
+    exit();
+}
+
+int main(int argc, char *argv[])
+{
+    struct swapstat before, after;
+    int passes = PASSES, maxpages = 0, trace;
+
+    if (argc > 1)
+        maxpages = atoi(argv[1]);
+    if (argc > 2)
+        passes = atoi(argv[2]);
+    if (passes < 1)
+        passes = 1;
+
+    trace = swaptrace(0);
+    getswapstats(0, &before);
+
+    printf(1, "pages\tfaults\tper1000\tswapin\tswapout\tclean\twait\tticks\ttouches/tick\n");
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (maxpages > 0 && sizes[i] > maxpages)
+            break;
+        if (fork() == 0)
+            Child_Function(sizes[i], passes);
+        wait();
+    }
+
+    getswapstats(0, &after);
+    printf(1, "total: %d faults, %d frames scanned, %d ticks waiting for memory\n",
+           after.faults - before.faults, after.scanned - before.scanned,
+           after.waitticks - before.waitticks);
+    swaptrace(trace);
+    exit();
+}
@@ -0,0 +1,11 @@
+// Swap activity, as reported by getswapstats().
+// For a single process the counts cover its own pages; the
+// system-wide totals (pid 0) also count the CLOCK scan.
+struct swapstat {
+  uint faults;     // Page faults on swapped-out pages
+  uint swapins;    // Pages read from swap, read-ahead included
+  uint swapouts;   // Pages written to swap
+  uint cleandrops; // Pages evicted without a write (swap cache)
+  uint scanned;    // Frames examined by the CLOCK hand
+  uint waitticks;  // Ticks spent waiting in kalloc() for a free page
+};
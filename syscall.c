@@ -65,6 +65,7 @@ argptr(int n, char **pp, int size)
     return -1;
   if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
     return -1;
+  uvmprefault(curproc, i, size, 0);
   *pp = (char*)i;
   return 0;
 }
@@ -108,6 +109,13 @@ extern int sys_history(void);
 extern int sys_wait2(void);
 extern int sys_set_prio(void);
 extern int sys_yield(void);
+extern int sys_getswapstats(void);
+extern int sys_swaptrace(void);
+extern int sys_setsched(void);
+extern int sys_clock_gettime(void);
+extern int sys_wait3(void);
+extern int sys_yieldto(void);
+extern int sys_setgroup(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]     sys_fork,
@@ -135,7 +143,14 @@ static int (*syscalls[])(void) = {
 [SYS_history]  sys_history,
 [SYS_wait2]    sys_wait2,
 [SYS_set_prio] sys_set_prio,
-[SYS_yield]    sys_yield
+[SYS_yield]    sys_yield,
+[SYS_getswapstats] sys_getswapstats,
+[SYS_swaptrace] sys_swaptrace,
+[SYS_setsched] sys_setsched,
+[SYS_clock_gettime] sys_clock_gettime,
+[SYS_wait3]    sys_wait3,
+[SYS_yieldto]  sys_yieldto,
+[SYS_setgroup] sys_setgroup,
 };
 
 void
@@ -24,4 +24,11 @@
 #define SYS_history  23
 #define SYS_wait2    24
 #define SYS_set_prio 25
-#define SYS_yield    26
\ No newline at end of file
+#define SYS_yield    26
+#define SYS_getswapstats 27
+#define SYS_swaptrace 28
+#define SYS_setsched 29
+#define SYS_clock_gettime 30
+#define SYS_wait3    31
+#define SYS_yieldto  32
+#define SYS_setgroup 33
\ No newline at end of file
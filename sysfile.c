@@ -75,6 +75,7 @@ sys_read(void)
 
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
     return -1;
+  uvmprefault(myproc(), (uint)p, n, 1);
   return fileread(f, p, n);
 }
 
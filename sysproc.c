@@ -6,6 +6,8 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "swapstat.h"
+#include "clock.h"
 
 int
 sys_fork(void)
@@ -38,7 +40,23 @@ sys_wait2(void)
     return -1;
   if (argptr(3, (void*)&ctime, sizeof(ctime)) < 0)
     return -1;
-  return waitstats(retime, rutime, stime, ctime);
+  return waitstats(retime, rutime, stime, ctime, 0);
+}
+
+int
+sys_wait3(void)
+{
+  int *retime, *rutime, *stime, *ctime;
+  struct proctimes *pt;
+
+  if (argptr(0, (void*)&retime, sizeof(*retime)) < 0 ||
+      argptr(1, (void*)&rutime, sizeof(*rutime)) < 0 ||
+      argptr(2, (void*)&stime, sizeof(*stime)) < 0 ||
+      argptr(3, (void*)&ctime, sizeof(*ctime)) < 0 ||
+      argptr(4, (void*)&pt, sizeof(*pt)) < 0)
+    return -1;
+  uvmprefault(myproc(), (uint)pt, sizeof(*pt), 1);
+  return waitstats(retime, rutime, stime, ctime, pt);
 }
 
 int
@@ -86,7 +104,7 @@ sys_sleep(void)
       release(&tickslock);
       return -1;
     }
-    sleep(&ticks, &tickslock);
+    twsleep(ticks0 + n);
   }
   release(&tickslock);
   return 0;
@@ -181,4 +199,55 @@ int sys_set_prio(void) {
 int sys_yield(void) {
   yield();
   return 0;
-}
\ No newline at end of file
+}
+
+int sys_yieldto(void) {
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return yieldto(pid);
+}
+
+int sys_setgroup(void) {
+  int g;
+
+  if(argint(0, &g) < 0)
+    return -1;
+  return setgroup(g);
+}
+
+int sys_getswapstats(void) {
+  int pid;
+  struct swapstat *st;
+
+  if(argint(0, &pid) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  uvmprefault(myproc(), (uint)st, sizeof(*st), 1);
+  return getswapstats(pid, st);
+}
+
+int sys_swaptrace(void) {
+  int on;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  return setswaptrace(on);
+}
+
+int sys_setsched(void) {
+  int id;
+
+  if(argint(0, &id) < 0)
+    return -1;
+  return setsched(id);
+}
+
+int sys_clock_gettime(void) {
+  int clock;
+  struct timespec *ts;
+
+  if(argint(0, &clock) < 0 || argptr(1, (void*)&ts, sizeof(*ts)) < 0)
+    return -1;
+  return clockgettime(clock, ts);
+}
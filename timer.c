@@ -0,0 +1,138 @@
+// Timer wheel for sys_sleep().
+//
+// A process in sys_sleep() is filed under the tick it is due to
+// wake at, so the clock interrupt only looks at the processes
+// whose time has come instead of waking every sleeper on every
+// tick.  The wheel has TWLEVELS levels of TWSIZE slots: level 0
+// holds deadlines less than TWSIZE ticks away, one slot per tick,
+// and each level above covers TWSIZE times the span of the one
+// below with slots as wide as that whole level.  Each time level 0
+// wraps around, the next slot of level 1 is emptied back into the
+// wheel, which spreads its processes over level 0, and so on up
+// (see cascade), so a process is moved at most TWLEVELS-1 times.
+//
+// The wheel is protected by tickslock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define TWBITS    6
+#define TWSIZE    (1 << TWBITS)
+#define TWMASK    (TWSIZE - 1)
+#define TWLEVELS  4
+#define TWMAX     ((1 << (TWBITS * TWLEVELS)) - 1)  // Furthest deadline
+
+// Index into level l of the slot for tick t.
+#define TWINDEX(t, l)  (((t) >> (TWBITS * (l))) & TWMASK)
+
+static struct proc *wheel[TWLEVELS][TWSIZE];
+static uint twbase = 1;   // Next tick to run; ticks starts at 0
+
+// File p in the slot for p->sleepuntil.
+static void
+twadd(struct proc *p)
+{
+  uint delta = p->sleepuntil - twbase;
+  int l;
+
+  if((int)delta < 0){
+    // Already due: run it with the next tick.
+    p->sleepuntil = twbase;
+    delta = 0;
+  } else if(delta > TWMAX){
+    // Out of range: wake early; sys_sleep() goes back to sleep.
+    p->sleepuntil = twbase + TWMAX;
+    delta = TWMAX;
+  }
+  for(l = 0; l < TWLEVELS-1; l++)
+    if(delta < (1 << (TWBITS * (l+1))))
+      break;
+  p->twlist = &wheel[l][TWINDEX(p->sleepuntil, l)];
+  p->twprev = 0;
+  p->twnext = *p->twlist;
+  if(p->twnext)
+    p->twnext->twprev = p;
+  *p->twlist = p;
+}
+
+// Take p off the wheel, if it is on it.
+static void
+twdel(struct proc *p)
+{
+  if(p->twlist == 0)
+    return;
+  if(p->twprev)
+    p->twprev->twnext = p->twnext;
+  else
+    *p->twlist = p->twnext;
+  if(p->twnext)
+    p->twnext->twprev = p->twprev;
+  p->twlist = 0;
+  p->twnext = p->twprev = 0;
+}
+
+// Refile every process in slot i of level l, and return i.
+static int
+cascade(int l, int i)
+{
+  struct proc *p;
+
+  while((p = wheel[l][i]) != 0){
+    twdel(p);
+    twadd(p);
+  }
+  return i;
+}
+
+// Sleep until tick expires, or until killed.
+// The caller must hold tickslock.
+void
+twsleep(uint expires)
+{
+  struct proc *p = myproc();
+
+  p->sleepuntil = expires;
+  twadd(p);
+  sleep(&p->sleepuntil, &tickslock);
+  twdel(p);
+}
+
+// Wake the processes due at every tick up to now.
+// Called from tickadvance() with tickslock held.
+//
+// A due process that is not asleep on its channel right now, such
+// as one whose page evictPage() is writing out (it clears chan for
+// the duration), is filed again for the next tick rather than
+// dropped.  That is always safe: a process on the wheel has not yet
+// taken itself off in twsleep(), and will once it runs.
+void
+twrun(uint now)
+{
+  struct proc *p, *retry;
+  int i, l;
+
+  while((int)(now - twbase) >= 0){
+    i = TWINDEX(twbase, 0);
+    for(l = 1; i == 0 && l < TWLEVELS; l++)
+      i = cascade(l, TWINDEX(twbase, l));
+    retry = 0;
+    while((p = wheel[0][TWINDEX(twbase, 0)]) != 0){
+      twdel(p);
+      if(!wakeupproc(p, &p->sleepuntil)){
+        p->twnext = retry;
+        retry = p;
+      }
+    }
+    twbase++;
+    while((p = retry) != 0){
+      retry = p->twnext;
+      p->sleepuntil = twbase;
+      twadd(p);
+    }
+  }
+}
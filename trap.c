@@ -13,9 +13,6 @@ struct gatedesc idt[256];
 extern uint vectors[]; // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
-pte_t pte;
-extern int inc_ticks_elapsed(void);
-extern void dec_prio(void);
 
 void tvinit(void)
 {
@@ -33,9 +30,30 @@ void idtinit(void)
   lidt(idt, sizeof(idt));
 }
 
+// Advance the clock by n ticks.  Cpu 0 calls this on each timer
+// interrupt, and with the ticks it skipped when it leaves
+// tickless idle.
+void tickadvance(uint n)
+{
+  uint t0;
+
+  acquire(&tickslock);
+  t0 = ticks;
+  while (n-- > 0)
+  {
+    ticks++;
+    twrun(ticks);
+  }
+  release(&tickslock);
+  if (ticks / BOOSTTICKS != t0 / BOOSTTICKS)
+    boost_prio();
+}
+
 //PAGEBREAK: 41
 void trap(struct trapframe *tf)
 {
+  pte_t *ptep, pte;
+
   if (tf->trapno == T_SYSCALL)
   {
     if (myproc()->killed)
@@ -47,24 +65,28 @@ void trap(struct trapframe *tf)
     return;
   }
 
+  // Bring the clock up to date before waking anyone.
+  if (tf->trapno >= T_IRQ0 && tf->trapno != T_IRQ0 + IRQ_TIMER)
+    clocksync();
+
   switch (tf->trapno)
   {
   case T_IRQ0 + IRQ_TIMER:
-    if (cpuid() == 0)
+    // In tickless idle, cpu 0 catches up when it wakes (see idle).
+    if (!mycpu()->tickless)
     {
-      acquire(&tickslock);
-      ticks++;
-      updatestats();
-      wakeup(&ticks);
-      release(&tickslock);
+      lapictimer();
+      if (cpuid() == 0)
+        tickadvance(1);
     }
     lapiceoi();
     break;
+  case T_IRQ0 + IRQ_WAKE:
+    // Another CPU has work for this one; waking from hlt is all
+    // that is needed.
+    lapiceoi();
+    break;
   case T_IRQ0 + IRQ_IDE:
-#ifdef FCFS
-#else
-// resettickscycle();
-#endif
     ideintr();
     lapiceoi();
     break;
@@ -72,18 +94,10 @@ void trap(struct trapframe *tf)
     // Bochs generates spurious IDE1 interrupts.
     break;
   case T_IRQ0 + IRQ_KBD:
-#ifdef FCFS
-#else
-// resettickscycle();
-#endif
     kbdintr();
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_COM1:
-#ifdef FCFS
-#else
-// resettickscycle();
-#endif
     uartintr();
     lapiceoi();
     break;
@@ -94,19 +108,38 @@ void trap(struct trapframe *tf)
     lapiceoi();
     break;
   case T_PGFLT:
-    pte = *getpte(myproc()->pgdir,(void *)rcr2());
-    cprintf("|       Page Fault          |  -  | -  | Page fault has occured due to insufficient memory |\n");
+    if((tf->err & 2) && cowfault(myproc()->pgdir, rcr2()) == 0)
+      break;
+    if(rcr2() < myproc()->sz && lazyfault(myproc(), rcr2()) == 0)
+      break;
+    ptep = getpte(myproc()->pgdir,(void *)rcr2());
+    pte = ptep ? *ptep : 0;
+    if(swaptrace)
+      cprintf("|       Page Fault          |  -  | -  | Page fault has occured due to insufficient memory |\n");
     myproc()->trapva = rcr2();
-    if(myproc()->trapva < myproc()->sz && (pte&((uint)1<<7)) != 0)
+    if(myproc()->trapva < myproc()->sz && (pte & PTE_SWAP) != 0)
     {
       submitReqToSwapIn();
       break;
     }
+    if ((tf->cs & 3) == 0)
+    {
+      // Returning would fault again on the same instruction.
+      cprintf("unexpected page fault from cpu %d eip %x (cr2=0x%x)\n",
+              cpuid(), tf->eip, rcr2());
+      panic("trap");
+    }
     myproc()->killed = 1;
     break;
 
   //PAGEBREAK: 13
   default:
+    if (virtioirq && tf->trapno == T_IRQ0 + virtioirq)
+    {
+      virtiointr();
+      lapiceoi();
+      break;
+    }
     if (myproc() == 0 || (tf->cs & 3) == 0)
     {
       // In kernel, it must be our mistake.
@@ -128,37 +161,13 @@ void trap(struct trapframe *tf)
   if (myproc() && myproc()->killed && (tf->cs & 3) == DPL_USER)
     exit();
 
-#ifdef FCFS
-    // do not yield
-    // since this is non-preemptive
-#else
-#ifdef DML
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU on a clock tick if the
+  // scheduling class says its turn is over.
   // If interrupts were on while locks held, would need to check nlock.
-  if (myproc() && myproc()->state == RUNNING && tf->trapno == T_IRQ0 + IRQ_TIMER && inc_ticks_elapsed() == QUANTA)
+  if (myproc() && myproc()->state == RUNNING && tf->trapno == T_IRQ0 + IRQ_TIMER && schedtick())
   {
-    dec_prio();
     yield();
   }
-#else
-#ifdef SML
-  // do nothing
-  if (myproc() && myproc()->state == RUNNING && tf->trapno == T_IRQ0 + IRQ_TIMER)
-  {
-    yield();
-  }
-#else
-  // DEFAULT round robin case
-  // Force process to give up CPU on expiring QUANTA.
-  // If interrupts were on while locks held, would need to check nlock.
-  if (myproc() && myproc()->state == RUNNING && tf->trapno == T_IRQ0 + IRQ_TIMER && inc_ticks_elapsed() == QUANTA)
-  {
-    yield();
-  }
-
-#endif
-#endif
-#endif
 
   // Check if the process has been killed since we yielded
   if (myproc() && myproc()->killed && (tf->cs & 3) == DPL_USER)
@@ -1,5 +1,8 @@
 struct stat;
 struct rtcdate;
+struct swapstat;
+struct timespec;
+struct proctimes;
 
 // system calls
 int fork(void);
@@ -28,6 +31,13 @@ int history(char*, int);
 int wait2(int*, int*, int*, int*);
 int set_prio(int);
 int yield(void);
+int getswapstats(int, struct swapstat*);
+int swaptrace(int);
+int setsched(int);
+int clock_gettime(int, struct timespec*);
+int wait3(int*, int*, int*, int*, struct proctimes*);
+int yieldto(int);
+int setgroup(int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -0,0 +1,256 @@
+// Virtio block device driver, for the legacy PCI interface.
+//
+// When QEMU is given a virtio-blk disk (make DISK=virtio), it holds
+// the file system instead of IDE disk 1, and iderwv() hands it the
+// requests for ROOTDEV.  Unlike the IDE disk, which runs one command
+// at a time, the device takes every request placed on its queue and
+// may finish them in any order, so a batch of bufs is queued with a
+// single notification and each waiter is woken as its own request
+// completes.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "pci.h"
+#include "virtio.h"
+
+#define SECTOR_SIZE 512
+#define VQMAX       256  // largest queue the memory below holds
+
+// Bytes for the descriptor table and available ring of an n-entry
+// queue, and for the used ring, each rounded up to a page.
+#define VQRINGS(n)  PGROUNDUP(16*(n) + 6 + 2*(n))
+#define VQUSED(n)   PGROUNDUP(6 + 8*(n))
+
+// The queue must be physically contiguous and page aligned.
+static uchar vqmem[VQRINGS(VQMAX) + VQUSED(VQMAX)]
+  __attribute__((__aligned__(PGSIZE)));
+
+int virtioirq;        // interrupt line, 0 if there is no device
+
+static struct {
+  struct spinlock lock;
+  uint base;          // I/O port base
+  uint nsect;         // disk size in sectors
+  int n;              // entries in the queue
+  struct virtq_desc *desc;
+  struct virtq_avail *avail;
+  struct virtq_used *used;
+  ushort usedidx;     // first used entry not yet looked at
+  char free[VQMAX];   // is descriptor i free?
+  int nfree;
+
+  // For the request whose chain starts at descriptor i.
+  struct {
+    struct virtio_blk_req hdr;
+    uchar status;
+    struct buf *b;
+  } req[VQMAX];
+} vio;
+
+void
+virtioinit(void)
+{
+  uint tag, bar, cmd;
+  int i;
+
+  initlock(&vio.lock, "virtio");
+  if(pcifind(PCI_ID, 0xffffffff, (VIRTIO_DEV_BLK<<16) | VIRTIO_VENDOR, &tag) < 0)
+    return;
+  bar = pciread(tag, PCI_BAR(0));
+  if(!(bar & PCI_BAR_IO))
+    return;
+  cmd = pciread(tag, PCI_CMD) & 0xffff;
+  pciwrite(tag, PCI_CMD, cmd | PCI_CMD_IO | PCI_CMD_MASTER);
+  vio.base = bar & PCI_BAR_IOMASK;
+
+  // Reset, and say that there is a driver.  No optional features.
+  outb(vio.base + VIRTIO_STATUS, 0);
+  outb(vio.base + VIRTIO_STATUS, VIRTIO_STATUS_ACK);
+  outb(vio.base + VIRTIO_STATUS, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+  outl(vio.base + VIRTIO_DRVFEATURES, 0);
+
+  // The legacy interface cannot shrink the queue, so it has to fit.
+  outw(vio.base + VIRTIO_QSEL, 0);
+  vio.n = inw(vio.base + VIRTIO_QSIZE);
+  if(vio.n < 3 || vio.n > VQMAX){
+    cprintf("virtio: queue size %d not supported\n", vio.n);
+    outb(vio.base + VIRTIO_STATUS, VIRTIO_STATUS_FAILED);
+    return;
+  }
+  memset(vqmem, 0, sizeof(vqmem));
+  vio.desc = (struct virtq_desc*)vqmem;
+  vio.avail = (struct virtq_avail*)(vqmem + 16*vio.n);
+  vio.used = (struct virtq_used*)(vqmem + VQRINGS(vio.n));
+  for(i = 0; i < vio.n; i++)
+    vio.free[i] = 1;
+  vio.nfree = vio.n;
+  outl(vio.base + VIRTIO_QADDR, V2P(vqmem) / PGSIZE);
+  outb(vio.base + VIRTIO_STATUS,
+       VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+  vio.nsect = inl(vio.base + VIRTIO_BLK_CAPACITY);
+  virtioirq = pciread(tag, PCI_INTR) & 0xff;
+  ioapicenable(virtioirq, ncpu - 1);
+  cprintf("virtio: disk of %d sectors, queue %d, irq %d\n",
+          vio.nsect, vio.n, virtioirq);
+}
+
+// Is there a virtio disk to hold the file system?
+int
+virtiodisk(void)
+{
+  return virtioirq != 0;
+}
+
+// Take a free descriptor.  Caller must hold vio.lock and know that
+// there is one.
+static int
+vqalloc(void)
+{
+  int i;
+
+  for(i = 0; i < vio.n; i++){
+    if(vio.free[i]){
+      vio.free[i] = 0;
+      vio.nfree--;
+      return i;
+    }
+  }
+  panic("vqalloc");
+}
+
+// Free the descriptor chain that starts at i.
+static void
+vqfree(int i)
+{
+  int flags;
+
+  for(;;){
+    flags = vio.desc[i].flags;
+    vio.free[i] = 1;
+    vio.nfree++;
+    if(!(flags & VRING_DESC_F_NEXT))
+      break;
+    i = vio.desc[i].next;
+  }
+}
+
+// Put the request for b on the queue.  Caller must hold vio.lock,
+// and the queue must have three free descriptors.
+static void
+vqsubmit(struct buf *b)
+{
+  int d0, d1, d2, len;
+  uint sector;
+
+  len = b->page ? PGSIZE : BSIZE;
+  sector = b->blockno * (BSIZE/SECTOR_SIZE);
+  if(sector + len/SECTOR_SIZE > vio.nsect)
+    panic("virtio: blockno");
+
+  d0 = vqalloc();
+  d1 = vqalloc();
+  d2 = vqalloc();
+  vio.req[d0].hdr.type = (b->flags & B_DIRTY) ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  vio.req[d0].hdr.reserved = 0;
+  vio.req[d0].hdr.sector = sector;
+  vio.req[d0].status = 0xff;
+  vio.req[d0].b = b;
+
+  vio.desc[d0].addr = V2P(&vio.req[d0].hdr);
+  vio.desc[d0].len = sizeof(struct virtio_blk_req);
+  vio.desc[d0].flags = VRING_DESC_F_NEXT;
+  vio.desc[d0].next = d1;
+
+  vio.desc[d1].addr = V2P(b->page ? b->page : b->data);
+  vio.desc[d1].len = len;
+  vio.desc[d1].flags = VRING_DESC_F_NEXT;
+  if(!(b->flags & B_DIRTY))
+    vio.desc[d1].flags |= VRING_DESC_F_WRITE;
+  vio.desc[d1].next = d2;
+
+  vio.desc[d2].addr = V2P(&vio.req[d0].status);
+  vio.desc[d2].len = 1;
+  vio.desc[d2].flags = VRING_DESC_F_WRITE;
+  vio.desc[d2].next = 0;
+
+  vio.avail->ring[vio.avail->idx % vio.n] = d0;
+  __sync_synchronize();  // the entry before the index
+  vio.avail->idx++;
+}
+
+// Sync n bufs with the disk, as iderwv() does.  All of them go on
+// the queue before the device is notified, as far as the queue has
+// room; if it fills up, the device is told about what is there and
+// the rest wait for descriptors to come free.
+void
+virtiorw(struct buf **bv, int n)
+{
+  int i, queued;
+
+  acquire(&vio.lock);
+  queued = 0;
+  for(i = 0; i < n; i++){
+    while(vio.nfree < 3){
+      if(queued){
+        outw(vio.base + VIRTIO_QNOTIFY, 0);
+        queued = 0;
+      }
+      sleep(&vio.nfree, &vio.lock);
+    }
+    vqsubmit(bv[i]);
+    queued++;
+  }
+  __sync_synchronize();  // the index before the notification
+  if(queued)
+    outw(vio.base + VIRTIO_QNOTIFY, 0);
+
+  // Wait for the requests to finish.
+  for(i = 0; i < n; i++){
+    while((bv[i]->flags & (B_VALID|B_DIRTY)) != B_VALID)
+      sleep(bv[i], &vio.lock);
+  }
+  release(&vio.lock);
+}
+
+// Interrupt handler: finish every request the device has put on
+// the used ring, in the order it finished them.
+void
+virtiointr(void)
+{
+  struct buf *b;
+  int d;
+
+  acquire(&vio.lock);
+
+  // Reading the ISR acknowledges the interrupt, so look at the
+  // used ring after it: anything finished later interrupts again.
+  inb(vio.base + VIRTIO_ISR);
+  __sync_synchronize();
+
+  while(vio.usedidx != vio.used->idx){
+    __sync_synchronize();  // the index before the entry
+    d = vio.used->ring[vio.usedidx % vio.n].id;
+    if(vio.req[d].status != VIRTIO_BLK_S_OK)
+      panic("virtio: request failed");
+    b = vio.req[d].b;
+    vio.req[d].b = 0;
+    b->flags |= B_VALID;
+    b->flags &= ~B_DIRTY;
+    wakeup(b);
+    vqfree(d);
+    vio.usedidx++;
+  }
+  wakeup(&vio.nfree);
+
+  release(&vio.lock);
+}
@@ -0,0 +1,62 @@
+// Virtio block device, legacy PCI interface.
+// See the Virtual I/O Device (VIRTIO) specification, "Legacy
+// Interface" sections.
+
+#define VIRTIO_VENDOR       0x1af4
+#define VIRTIO_DEV_BLK      0x1001  // transitional block device
+
+// Registers, from the I/O port base in BAR 0.
+#define VIRTIO_DEVFEATURES  0x00  // features the device offers (32)
+#define VIRTIO_DRVFEATURES  0x04  // features the driver accepts (32)
+#define VIRTIO_QADDR        0x08  // page number of the queue (32)
+#define VIRTIO_QSIZE        0x0c  // entries in the queue (16)
+#define VIRTIO_QSEL         0x0e  // queue the above refer to (16)
+#define VIRTIO_QNOTIFY      0x10  // tell the device a queue has work (16)
+#define VIRTIO_STATUS       0x12  // device status (8)
+#define VIRTIO_ISR          0x13  // interrupt status, cleared by reading (8)
+#define VIRTIO_BLK_CAPACITY 0x14  // disk size in sectors (64)
+
+// Device status bits.
+#define VIRTIO_STATUS_ACK       1
+#define VIRTIO_STATUS_DRIVER    2
+#define VIRTIO_STATUS_DRIVER_OK 4
+#define VIRTIO_STATUS_FAILED    128
+
+// A virtqueue: the descriptor table, then the available ring, then,
+// on the next page, the used ring.
+struct virtq_desc {
+  uint64 addr;          // physical address
+  uint len;
+  ushort flags;
+  ushort next;          // next descriptor of the chain
+};
+#define VRING_DESC_F_NEXT   1  // the chain continues at next
+#define VRING_DESC_F_WRITE  2  // the device writes this buffer
+
+struct virtq_avail {
+  ushort flags;
+  ushort idx;           // where the driver puts the next entry
+  ushort ring[];        // heads of descriptor chains
+};
+
+struct virtq_used_elem {
+  uint id;              // head of the finished descriptor chain
+  uint len;
+};
+
+struct virtq_used {
+  ushort flags;
+  ushort idx;           // where the device puts the next entry
+  struct virtq_used_elem ring[];
+};
+
+// A block request is a chain of three descriptors: this header,
+// the data, and a status byte the device fills in.
+struct virtio_blk_req {
+  uint type;
+  uint reserved;
+  uint64 sector;
+};
+#define VIRTIO_BLK_T_IN     0  // read
+#define VIRTIO_BLK_T_OUT    1  // write
+#define VIRTIO_BLK_S_OK     0
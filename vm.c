@@ -189,6 +189,7 @@ inituvm(pde_t *pgdir, char *init, uint sz)
   mem = kalloc();
   memset(mem, 0, PGSIZE);
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
+  frameset(mem, pgdir, 0);
   memmove(mem, init, sz);
 }
 
@@ -244,6 +245,7 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
       kfree(mem);
       return 0;
     }
+    frameset(mem, pgdir, a);
   }
   return newsz;
 }
@@ -273,6 +275,9 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
       char *v = P2V(pa);
       kfree(v);
       *pte = 0;
+    } else if((*pte & PTE_SWAP) != 0){
+      swapfree(PTE_SLOT(*pte));
+      *pte = 0;
     }
   }
   return newsz;
@@ -311,42 +316,150 @@ clearpteu(pde_t *pgdir, char *uva)
 }
 
 // Given a parent process's page table, create a copy
-// of it for a child.
+// of it for a child.  The child shares the parent's pages:
+// writable ones become read-only copy-on-write in both, and
+// cowfault() copies a page when either writes it.  Non-user
+// pages are copied outright.  Pages in
+// the swap area share their swap slot.  pgdir must be the
+// current page table.
 pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
-  pte_t *pte;
+  pte_t *pte, *npte;
   uint pa, i, flags;
-  char *mem;
+  char *v, *mem;
+  int slot;
 
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
-
-    *((char *)i)= *((char *)i) + 0;
-    if(!(*pte & PTE_P)&&*((char *)i) != *((char *)i)+0)
+    // Heap pages not yet touched stay that way in the child.
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0 || *pte == 0)
+      continue;
+    if(*pte & PTE_SWAP){
+      if((npte = walkpgdir(d, (void *) i, 1)) == 0)
+        goto bad;
+      swapdup(PTE_SLOT(*pte));
+      *npte = *pte;
+      continue;
+    }
+    if(!(*pte & PTE_P))
       panic("copyuvm: page not present");
 
     pa = PTE_ADDR(*pte);
+    v = P2V(pa);
+    // Only user pages are shared.  Others, like the stack guard
+    // page, which cowfault() would refuse to copy when the kernel
+    // writes to it, get a copy of their own as before.
+    if(!(*pte & PTE_U)){
+      if((mem = kalloc()) == 0)
+        goto bad;
+      memmove(mem, v, PGSIZE);
+      if(mappages(d, (void*)i, PGSIZE, V2P(mem), PTE_FLAGS(*pte)) < 0){
+        kfree(mem);
+        goto bad;
+      }
+      continue;
+    }
+    // A shared page never changes, so its swap cache copy stays
+    // good while it is shared; make sure it is good to begin with.
+    if((*pte & PTE_D) && krefcount(v) == 1 && (slot = frametakeslot(v)) >= 0)
+      swapfree(slot);
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
       goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
-      kfree(mem);
-      goto bad;
-    }
+    kref(v);
   }
+  lcr3(V2P(pgdir));
   return d;
 
 bad:
+  lcr3(V2P(pgdir));
   freevm(d);
   return 0;
 }
 
+// Map the page at va of p on its first touch: a heap page that
+// growproc() grew the process over, or a page of the program that
+// exec() left in the executable.  The caller checks that va is
+// below the process size.
+// Returns -1 if va already has a page, resident or swapped out,
+// or if the page cannot be read.
+int
+lazyfault(struct proc *p, uint va)
+{
+  pte_t *pte;
+  char *mem;
+
+  va = PGROUNDDOWN(va);
+  pte = walkpgdir(p->pgdir, (void *) va, 0);
+  if(pte && *pte)
+    return -1;
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if(execload(p, va, mem) < 0 ||
+     mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  frameset(mem, p->pgdir, va);
+  return 0;
+}
+
+// Fault in user memory [va, va+len) before the kernel uses it:
+// map untouched heap pages and, if the kernel will write it, copy
+// copy-on-write pages.  Code that touches user memory while holding
+// a spinlock (piperead, consoleread) could not wait for a page in
+// trap().  The caller has checked the range against the process size.
+void
+uvmprefault(struct proc *p, uint va, uint len, int write)
+{
+  uint a;
+
+  for(a = PGROUNDDOWN(va); a < va + len; a += PGSIZE){
+    lazyfault(p, a);
+    if(write)
+      cowfault(p->pgdir, a);
+  }
+}
+
+// Handle a write to the copy-on-write page at va: give the
+// faulting process its own writable copy, or the page itself
+// if no one else shares it any more.
+// Returns -1 if va is not a copy-on-write page.
+int
+cowfault(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  uint pa;
+  char *mem;
+
+  va = PGROUNDDOWN(va);
+  pte = walkpgdir(pgdir, (void *) va, 0);
+  if(pte == 0 || (*pte & (PTE_P|PTE_U|PTE_COW)) != (PTE_P|PTE_U|PTE_COW))
+    return -1;
+  pa = PTE_ADDR(*pte);
+  if(krefcount(P2V(pa)) == 1){
+    *pte = (*pte & ~PTE_COW) | PTE_W;
+    frameset(P2V(pa), pgdir, va);
+  } else {
+    // kalloc() may wait for the swapout process, which leaves
+    // the pages of processes waiting for memory alone.
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, P2V(pa), PGSIZE);
+    *pte = V2P(mem) | (PTE_FLAGS(*pte) & ~(PTE_COW|PTE_D)) | PTE_W;
+    frameset(mem, pgdir, va);
+    kfree(P2V(pa));
+  }
+  lcr3(V2P(pgdir));
+  return 0;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -398,7 +511,7 @@ void swapInMap(pde_t *pgdir, void *va, uint size, uint pa){
   uint flags = PTE_FLAGS(*pte);
   if (flags % 2 ==1) cprintf("Present Set\n");
 
-  uint num = 1 << 7;
+  uint num = PTE_SWAP;
   num = ~num;
   flags = flags & num;
   num = 1 << 6;
@@ -406,6 +519,7 @@ void swapInMap(pde_t *pgdir, void *va, uint size, uint pa){
   flags = flags & num;
 
   *pte = pa | flags | PTE_P;
+  frameset(P2V(pa), pgdir, PGROUNDDOWN((uint)va));
 }
 
 //PAGEBREAK!